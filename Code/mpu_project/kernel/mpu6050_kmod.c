@@ -2,8 +2,15 @@
 /*
  * MPU6050 kernel module with char device and sysfs attributes
  * Compatible with Raspberry Pi approach (create client manually).
- * Exposes /dev/mpu6050 (read returns 6 bytes: ax,ay,az as little-endian int16)
- * Also creates sysfs attrs accel_x/y/z,temp,gyro_x/y/z
+ * One module load drives up to MPU_MAX_DEVICES sensors (i2c_bus/i2c_addr
+ * are lists, e.g. i2c_addr=0x68,0x69); sensor N gets /dev/mpu6050-N, and
+ * sensor 0 is also /dev/mpu6050 for the older single-sensor tools.
+ * Acquisition modes (uapi MPU_MODE_*) are on-demand bursts, the on-chip
+ * FIFO, the data-ready interrupt and an hrtimer; every acquired sample is
+ * published once to a mmap()able ring that all readers, sysfs, IIO and
+ * the input device are served from. /dev/mpu6050-group reads several
+ * sensors in one bus transfer. Each section below describes its mechanism.
+ * Also creates sysfs attrs accel_x/y/z,temp,gyro_x/y/z and "all".
  */
 
 #include <linux/module.h>
@@ -21,210 +28,4313 @@
 #include <linux/uaccess.h>
 #include <linux/mutex.h>
 #include <linux/ktime.h>
+#include <linux/build_bug.h>
+#include <linux/workqueue.h>
+#include <linux/wait.h>
+#include <linux/poll.h>
+#include <linux/interrupt.h>
+#include <linux/gpio/consumer.h>
+#include <linux/gpio/machine.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/log2.h>
+#include <linux/bitops.h>
+#include <linux/seqlock.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/idr.h>
+#include <linux/kref.h>
+#include <linux/list.h>
+#include <linux/sched.h>
+#include <linux/pm_runtime.h>
+#include <linux/hrtimer.h>
+#include <linux/kthread.h>
+#include <linux/regmap.h>
+#include <linux/input.h>
+#include <linux/completion.h>
+#if IS_ENABLED(CONFIG_IIO_TRIGGERED_BUFFER)
+#include <linux/iio/iio.h>
+#include <linux/iio/buffer.h>
+#include <linux/iio/trigger.h>
+#include <linux/iio/trigger_consumer.h>
+#include <linux/iio/triggered_buffer.h>
+#endif
+
+#include "mpu6050_uapi.h"
+
+/* acquisition start/end, ring push, reader wakeup and read() return, for perf/trace-cmd */
+#define CREATE_TRACE_POINTS
+#include "mpu6050_trace.h"
 
 #define DRIVER_NAME "mpu6050_kmod"
 #define DEVICE_NAME "mpu6050"
 #define MPU_ADDR_DEFAULT 0x68
+#define MPU_MAX_DEVICES 8         /* minors reserved for /dev/mpu6050-N */
+#define MPU_GROUP_MINOR MPU_MAX_DEVICES /* /dev/mpu6050-group */
+#define MPU_COMPAT_MINOR (MPU_MAX_DEVICES + 1) /* /dev/mpu6050, same as minor 0 */
+#define MPU_NR_MINORS (MPU_MAX_DEVICES + 2)
 
 /* Registers */
+#define REG_SMPLRT_DIV   0x19
+#define REG_CONFIG       0x1A
+#define REG_GYRO_CONFIG  0x1B
+#define REG_ACCEL_CONFIG 0x1C
+#define REG_MOT_THR      0x1F
+#define REG_MOT_DUR      0x20
+#define REG_FIFO_EN      0x23
+#define REG_INT_PIN_CFG  0x37
+#define REG_INT_ENABLE   0x38
+#define REG_INT_STATUS   0x3A
+#define REG_USER_CTRL    0x6A
 #define REG_PWR_MGMT_1   0x6B
+#define REG_PWR_MGMT_2   0x6C
+#define REG_FIFO_COUNTH  0x72
+#define REG_FIFO_R_W     0x74
 #define REG_ACCEL_XOUT_H 0x3B
 #define REG_TEMP_OUT_H   0x41
 #define REG_GYRO_XOUT_H  0x43
+#define REG_EXT_SENS_DATA_23 0x60
 #define REG_WHO_AM_I     0x75
 
-/* Sensitivities */
-#define ACCEL_SENS_2G 16384
-#define GYRO_SENS_250 131
+/* Sensitivities (LSB per g / per deg/s at the smallest range) */
+#define ACCEL_SENS_2G 16384
+#define GYRO_SENS_250 131
+
+/* gyro LSB per deg/s x10 per FS_SEL: 131, 65.5, 32.8, 16.4 */
+static const int mpu_gyro_sens_x10[] = { 1310, 655, 328, 164 };
+static const int mpu_gyro_range_dps[] = { 250, 500, 1000, 2000 };
+
+/* IIO scales per full-scale code: m/s^2 and rad/s per LSB, in nano units */
+static const int mpu_accel_scale_nano[] = { 598550, 1197101, 2394202, 4788403 };
+static const int mpu_gyro_scale_nano[]  = { 133231, 266462, 532113, 1064225 };
+
+/* accel(6) + temp(2) + gyro(6), contiguous from ACCEL_XOUT_H */
+#define MPU_BURST_LEN 14
+
+/* channel rate groups, in register (and FIFO frame) order */
+enum { MPU_GRP_ACCEL, MPU_GRP_TEMP, MPU_GRP_GYRO, MPU_NGRP };
+static const u8 mpu_grp_off[MPU_NGRP] = { 0, 6, 8 };   /* bytes from ACCEL_XOUT_H */
+static const u8 mpu_grp_len[MPU_NGRP] = { 6, 2, 6 };
+
+/* FIFO_EN / USER_CTRL / INT_STATUS bits */
+#define FIFO_EN_TEMP     0x80
+#define FIFO_EN_XG       0x40
+#define FIFO_EN_YG       0x20
+#define FIFO_EN_ZG       0x10
+#define FIFO_EN_ACCEL    0x08
+#define USER_CTRL_FIFO_EN    0x40
+#define USER_CTRL_FIFO_RESET 0x04
+#define FIFO_EN_GYRO     (FIFO_EN_XG | FIFO_EN_YG | FIFO_EN_ZG)
+#define INT_FIFO_OFLOW   0x10
+#define INT_DATA_RDY     0x01
+#define INT_MOT          0x40     /* same bit in INT_ENABLE and INT_STATUS */
+#define ACCEL_HPF_5HZ    0x01     /* ACCEL_CONFIG: feeds only the motion detector */
+#define MPU_MOT_MG_PER_LSB 2
+#define INT_PIN_LATCH_EN 0x20     /* hold INT high until cleared */
+#define INT_PIN_RD_CLEAR 0x10     /* any register read clears it */
+#define PWR_MGMT_1_SLEEP 0x40
+
+/* on-chip FIFO size; frames hold the rate-0 groups in burst order, up to MPU_BURST_LEN */
+#define MPU_HW_FIFO_SIZE 1024
+#define MPU_FIFO_CHUNK_FRAMES 18    /* 252 bytes per bus read */
+#define MPU_DECIM_MAX 1000
+#define MPU_TIMER_MAX_HZ 1000       /* a 14-byte burst takes ~0.4 ms at 400 kHz */
+
+/* power-on configuration written by probe */
+#define MPU_SMPLRT_DIV_INIT 0x07
+#define MPU_DLPF_CFG_INIT   0x01
+
+/* runtime PM defaults; gyro start-up is 30 ms typical per the datasheet */
+#define MPU_AUTOSUSPEND_MS 2000
+#define MPU_WARMUP_MS_INIT 30
+
+/* module params: one entry per sensor, a short i2c_bus/i2c_addr list repeats its last value */
+static int i2c_bus[MPU_MAX_DEVICES] = { 1 };
+static int n_i2c_bus;
+module_param_array(i2c_bus, int, &n_i2c_bus, 0444);
+MODULE_PARM_DESC(i2c_bus, "I2C bus per sensor (default 1)");
+
+static int i2c_addr[MPU_MAX_DEVICES] = { MPU_ADDR_DEFAULT };
+static int n_i2c_addr;
+module_param_array(i2c_addr, int, &n_i2c_addr, 0444);
+MODULE_PARM_DESC(i2c_addr, "I2C address per sensor, e.g. 0x68,0x69 (default 0x68)");
+
+
+static unsigned int ring_slots = 4096;
+module_param(ring_slots, uint, 0444);
+MODULE_PARM_DESC(ring_slots, "samples kept in the mmap ring, also each reader's backlog (rounded to power of 2, default 4096)");
+
+static unsigned int bus_retries = 2;
+module_param(bus_retries, uint, 0644);
+MODULE_PARM_DESC(bus_retries, "extra attempts for a failed data read (default 2)");
+
+static int irq_gpio[MPU_MAX_DEVICES] = { [0 ... MPU_MAX_DEVICES - 1] = -1 };
+static int n_irq_gpio;
+module_param_array(irq_gpio, int, &n_irq_gpio, 0444);
+MODULE_PARM_DESC(irq_gpio, "line offset on gpio_chip wired to each sensor's INT pin, e.g. 17 for BCM GPIO17 (default -1: none, poll the bus)");
+
+static char *gpio_chip = "pinctrl-bcm2835";
+module_param(gpio_chip, charp, 0444);
+MODULE_PARM_DESC(gpio_chip, "label of the GPIO chip irq_gpio counts on, see gpiodetect (default pinctrl-bcm2835)");
+
+static bool timer_rt;
+module_param(timer_rt, bool, 0444);
+MODULE_PARM_DESC(timer_rt, "run the MPU_MODE_TIMER sampling thread SCHED_FIFO (default off)");
+
+static int timer_cpu = -1;
+module_param(timer_cpu, int, 0444);
+MODULE_PARM_DESC(timer_cpu, "pin the MPU_MODE_TIMER sampling thread to this CPU (default -1: any)");
+
+static unsigned int input_poll_ms;
+module_param(input_poll_ms, uint, 0444);
+MODULE_PARM_DESC(input_poll_ms, "register an input device polled at this interval when not streaming (default 0: none)");
+
+/*
+ * Sensors created by mpu_init(). irq_gpio becomes a gpiod lookup of the
+ * "int" line for the client's device name, so no global GPIO numbers.
+ */
+struct mpu_slot {
+    struct i2c_client *client;
+    struct gpiod_lookup_table *lookup;
+    char dev_id[16];          /* i2c client name, <bus>-<addr> */
+};
+static struct mpu_slot mpu_slots[MPU_MAX_DEVICES];
+static int mpu_nr_slots;
+
+/* char device: one cdev for the whole minor range, minor -> mpu_devs[] */
+static dev_t mpu_devt;
+static struct cdev mpu_cdev;
+static struct cdev mpu_group_cdev;
+static struct cdev mpu_compat_cdev;
+static struct class *mpu_class;
+static DEFINE_IDA(mpu_minors);
+static DEFINE_MUTEX(mpu_devs_lock);
+static struct mpu_dev *mpu_devs[MPU_MAX_DEVICES];
+static struct dentry *mpu_debugfs_root;
+
+/* sensor configuration, written under the device lock */
+struct mpu_hw_cfg {
+    u8 smplrt_div;
+    u8 dlpf;                  /* DLPF_CFG 0..6 */
+    u8 accel_fs;              /* MPU_ACCEL_FS_* */
+    u8 gyro_fs;               /* MPU_GYRO_FS_* */
+};
+
+/* FIFO streaming state */
+struct mpu_stream {
+    bool enabled;             /* under the device lock */
+    bool gap;                 /* next record follows lost data */
+    unsigned int watermark;   /* records a file wants before poll() says readable */
+    struct delayed_work work;
+    u8 *chunk;                /* DMA-safe bounce buffer for FIFO_R_W */
+    u32 hw_overflows;
+
+    /* frame timing from the sensor's own sample clock, see mpu_fifo_stamp() */
+    bool ts_valid;            /* false until the first batch after a reset */
+    u64 last_ts;              /* stamp of the newest frame so far */
+    u64 last_drain;           /* time of the previous non-empty drain */
+    u64 period_q16;           /* learned frame period, ns << 16 */
+};
+
+/* data-ready interrupt state */
+struct mpu_drdy {
+    int irq;                  /* 0 when INT is not wired */
+    bool enabled;             /* DATA_RDY_EN set, under the device lock */
+    u64 irq_ts;               /* hard irq timestamp of the pending sample */
+};
+
+/* motion detector, shares the INT line with data-ready */
+struct mpu_motion {
+    bool enabled;             /* MOT_EN set, under the device lock */
+    u8 thr;                   /* MOT_THR, 0 when not configured */
+    u8 dur;                   /* MOT_DUR, ms */
+    u32 count;                /* events so far */
+    u64 last_ns;              /* hard irq time of the newest event */
+};
+
+/* hrtimer pacing: the timer only posts a deadline, the kthread does the read */
+struct mpu_timer {
+    struct hrtimer timer;
+    struct task_struct *thread; /* under mode_lock */
+    bool running;             /* under the device lock */
+    unsigned int rate_hz;     /* 0: follow the sensor ODR */
+    atomic64_t due;           /* deadline of the unserved tick, 0 if none */
+    atomic_t missed;          /* ticks lost since the last sample */
+};
+
+/* mmap-able sample ring; single producer, serialized by the device lock */
+struct mpu_ring {
+    void *mem;                /* vmalloc_user: header page + slots */
+    size_t size;
+    struct mpu_ring_hdr *hdr;
+    struct mpu_sample *slots;
+    u32 mask;
+};
+
+/*
+ * Latency statistics. Updated with atomics only so the hot path never
+ * takes a lock; buckets are log2 of microseconds (bucket 0 is < 1 us).
+ */
+#define MPU_HIST_BUCKETS 24
+
+struct mpu_hist {
+    atomic64_t count;
+    atomic64_t sum_ns;
+    atomic64_t min_ns;
+    atomic64_t max_ns;
+    atomic_long_t bucket[MPU_HIST_BUCKETS];
+};
+
+struct mpu_stats {
+    struct mpu_hist bus;          /* one I2C data transaction */
+    struct mpu_hist read;         /* one read() on /dev/mpu6050-N */
+    struct mpu_hist lock_wait;    /* waiting for the device lock on the data path */
+    struct mpu_hist wake;         /* runtime resume to first published sample */
+    struct mpu_hist timer_jitter; /* hrtimer deadline to start of its bus read */
+    atomic_long_t timer_missed;   /* ticks that found the previous one unserved */
+    atomic_long_t errors;         /* data reads that failed after retries */
+    atomic_long_t retries;
+};
+
+/* newest sample for sysfs; written in mpu_publish() under the device lock */
+struct mpu_snapshot {
+    seqcount_mutex_t seq;
+    struct mpu_sample s;      /* hdr.version == 0 until the first sample */
+    unsigned int max_age_ms;
+};
+
+/*
+ * Per-group rate schedule and the newest raw bytes of every group in burst
+ * layout; records take the groups that were not read from here. Under the
+ * device lock.
+ */
+struct mpu_chan {
+    u16 hz[MPU_NGRP];         /* 0: with every sample */
+    u64 last_ns[MPU_NGRP];    /* last read, 0: cache invalid */
+    u8 cache[MPU_BURST_LEN];
+    u8 fifo_grps;             /* BIT(MPU_GRP_*) in the FIFO frame */
+    u8 frame_len;             /* bytes per FIFO frame */
+};
+
+/* decimation filter history, cleared on every reset */
+#define MPU_NCHAN 7               /* accel x/y/z, temp, gyro x/y/z */
+
+struct mpu_filter_state {
+    u32 n;                    /* inputs in the current output block */
+    u16 flags;                /* MPU_REC_F_* collected over the block */
+    u8 pos;                   /* FIR: next history slot */
+    s32 sum[MPU_NCHAN];       /* boxcar */
+    u64 integ[MPU_CIC_MAX_STAGES][MPU_NCHAN]; /* CIC, modular arithmetic */
+    u64 comb[MPU_CIC_MAX_STAGES][MPU_NCHAN];
+    s16 hist[MPU_FIR_MAX_TAPS][MPU_NCHAN];    /* FIR */
+};
+
+/* filter stage in front of mpu_publish(); under the device lock */
+struct mpu_filter {
+    struct mpu_filter_cfg cfg;
+    s64 gain;                 /* CIC: decim^stages */
+    struct mpu_filter_state st;
+};
+
+/* adaptive output rate; under the device lock */
+struct mpu_adapt {
+    struct mpu_adaptive_cfg cfg;  /* cfg.lo_hz == 0: off */
+    struct work_struct work;      /* reprograms the sensor after a decision */
+    bool high;                    /* wanted state: active rate */
+    bool changed;                 /* flag the next record */
+    bool primed;                  /* mean[] holds a DC estimate */
+    s32 mean[3];                  /* accel DC estimate, LSB << 4 */
+    u64 energy;                   /* sum of squared AC accel this window, LSB^2 */
+    u32 n;                        /* samples this window */
+    u64 win_start;
+    u32 quiet;                    /* consecutive windows below down_mg */
+    u32 rms_mg;                   /* last complete window */
+    unsigned long switches;
+};
+
+/*
+ * Flight recorder. buf, state and the positions are under the device lock,
+ * cfg and the acquisition reference under lock.
+ */
+struct mpu_capture {
+    struct mutex lock;
+    struct mpu_capture_cfg cfg;
+    struct mpu_sample *buf;       /* vmalloc, len records */
+    u32 len;                      /* pre + post, 0: nothing armed */
+    u32 pos;                      /* next slot to write */
+    u32 filled;                   /* valid slots, up to len */
+    u32 left;                     /* records still to take after the trigger */
+    u32 trigger;                  /* slot of the trigger record */
+    u64 trigger_ns;
+    u16 state;                    /* MPU_CAPTURE_* */
+    u16 source;                   /* MPU_CAPTURE_SRC_* */
+    u32 id;                       /* bumped on every SET */
+    bool held;                    /* holds an acquisition reference */
+    bool closed;                  /* device unbound, no more arming */
+    struct work_struct work;      /* lets go of acquisition once frozen */
+};
+
+/* deferred hardware bring-up, see mpu_boot_work() */
+struct mpu_boot {
+    struct work_struct work;
+    struct completion done;
+    int err;                      /* valid once done */
+    u64 probe_ns;
+    u32 ready_us;                 /* probe to bring-up finished */
+};
+
+/* runtime PM state; times are CLOCK_MONOTONIC ns */
+struct mpu_pm {
+    u64 ready_ns;             /* samples are valid from here on */
+    u64 wake_ns;              /* last resume, 0 once its first sample is out */
+    u32 last_wake_us;
+    unsigned int warmup_ms;
+};
+
+#if IS_ENABLED(CONFIG_INPUT)
+struct mpu_input {
+    struct input_dev *dev;
+    bool open;                    /* an evdev client has it open */
+    u8 accel_fs;                  /* ranges behind the advertised resolution */
+    u8 gyro_fs;
+};
+#endif
+
+#if IS_ENABLED(CONFIG_IIO_TRIGGERED_BUFFER)
+struct mpu_iio {
+    struct iio_dev *indio_dev;
+    struct iio_trigger *trig;
+    bool trig_on;                 /* our trigger has a consumer */
+    const struct mpu_sample *cur; /* sample behind the current own-trigger poll */
+};
+#endif
+
+/*
+ * One sensor. Freed when the last reference goes: probe holds one, every
+ * open file another, so a file outliving unbind only sees -ENODEV.
+ */
+struct mpu_dev {
+    struct i2c_client *client;
+    struct regmap *regmap;    /* devm, only valid until md->dead */
+    struct kref ref;
+    int minor;
+    bool dead;                /* removed, no more bus access; under lock */
+    bool full_i2c;            /* adapter can do plain I2C transfers */
+    struct mutex lock;        /* protect i2c ops */
+    u32 seq;                  /* sample sequence, under lock */
+    u16 odr_hz;               /* derived from cfg */
+    struct mpu_hw_cfg cfg;
+    bool cfg_changed;         /* flag the next record */
+    wait_queue_head_t wq;     /* new data for readers */
+
+    /* acquisition mode, changed under mode_lock */
+    struct mutex mode_lock;
+    u32 mode;
+    int users;                /* open files, under mode_lock */
+    struct list_head files;   /* struct mpu_file, under mode_lock */
+    u32 mode_start;           /* ring head at the last mode switch */
+
+    struct mpu_stream stream;
+    struct mpu_drdy drdy;
+    struct mpu_motion motion;
+    struct mpu_timer timer;
+    struct mpu_ring ring;
+    struct mpu_snapshot snap;
+    struct mpu_chan chan;
+    struct mpu_filter filter;
+    struct mpu_adapt adapt;
+    struct mpu_capture capture;
+    struct mpu_stats stats;
+    struct mpu_boot boot;
+    struct mpu_pm pm;
+    struct dentry *debugfs_dir;
+#if IS_ENABLED(CONFIG_INPUT)
+    struct mpu_input input;
+#endif
+#if IS_ENABLED(CONFIG_IIO_TRIGGERED_BUFFER)
+    struct mpu_iio iio;
+#endif
+};
+
+static void mpu_iio_push(struct mpu_dev *md, const struct mpu_sample *s);
+static void mpu_input_push(struct mpu_dev *md, const struct mpu_sample *s);
+static void mpu_adapt_feed(struct mpu_dev *md, const struct mpu_sample *s);
+static void mpu_capture_push(struct mpu_dev *md, const struct mpu_sample *s);
+static int mpu_fifo_reset(struct mpu_dev *md);
+static void mpu_fifo_drain(struct mpu_dev *md);
+
+/* per open file state: a private cursor into the shared sample ring */
+struct mpu_file {
+    struct mpu_dev *md;
+    struct list_head node;    /* in md->files */
+    struct mutex read_lock;   /* serializes readers of this file */
+    u32 fmt;                  /* MPU_FMT_* */
+    u32 cursor;               /* next ring index to consume */
+    u32 decim;                /* hand out every decim-th sample */
+    u32 skip;                 /* samples to pass over before the next one */
+    bool gap;                 /* this file lost samples before the next record */
+    u32 motion_seen;          /* motion.count at the last MPU_IOC_GET_MOTION_EVENT */
+    u32 clock;                /* CLOCK_* of hdr.timestamp_ns for this file */
+    u64 delivered;
+    u64 overruns;             /* samples overwritten before this file got to them */
+    pid_t pid;
+    char comm[TASK_COMM_LEN];
+};
+
+/* ---------- statistics ---------- */
+/* lock-free log2 latency histograms, dumped by debugfs */
+static void mpu_hist_reset(struct mpu_hist *h)
+{
+    int i;
+
+    atomic64_set(&h->count, 0);
+    atomic64_set(&h->sum_ns, 0);
+    atomic64_set(&h->min_ns, S64_MAX);
+    atomic64_set(&h->max_ns, 0);
+    for (i = 0; i < MPU_HIST_BUCKETS; i++)
+        atomic_long_set(&h->bucket[i], 0);
+}
+
+static void mpu_hist_add(struct mpu_hist *h, s64 ns)
+{
+    u64 us = ns > 0 ? div_u64(ns, NSEC_PER_USEC) : 0;
+    int b = us ? min_t(int, ilog2(us) + 1, MPU_HIST_BUCKETS - 1) : 0;
+    s64 old;
+
+    atomic_long_inc(&h->bucket[b]);
+    atomic64_inc(&h->count);
+    atomic64_add(ns, &h->sum_ns);
+    old = atomic64_read(&h->min_ns);
+    while (ns < old && !atomic64_try_cmpxchg(&h->min_ns, &old, ns))
+        ;
+    old = atomic64_read(&h->max_ns);
+    while (ns > old && !atomic64_try_cmpxchg(&h->max_ns, &old, ns))
+        ;
+}
+
+/* take the device lock on the data path, accounting the wait */
+static void mpu_bus_lock(struct mpu_dev *md)
+{
+    ktime_t t0 = ktime_get();
+
+    mutex_lock(&md->lock);
+    mpu_hist_add(&md->stats.lock_wait, ktime_to_ns(ktime_sub(ktime_get(), t0)));
+}
+
+/*
+ * Bus helpers. Callers hold md->lock (or are in probe), which also orders
+ * them against remove(): once md->dead is set the client may be gone.
+ */
+
+/*
+ * Registers go through regmap-i2c: configuration is cached (rbtree), data,
+ * status and FIFO registers are volatile.
+ */
+
+/* sample data, status and FIFO change under us; status and FIFO reads also consume */
+static const struct regmap_range mpu_volatile_ranges[] = {
+    regmap_reg_range(REG_INT_STATUS, REG_EXT_SENS_DATA_23),
+    regmap_reg_range(REG_USER_CTRL, REG_USER_CTRL),   /* self-clearing reset bits */
+    regmap_reg_range(REG_FIFO_COUNTH, REG_FIFO_R_W),
+};
+
+/* what we configure; resume replays only these, never WHO_AM_I or data */
+static const struct regmap_range mpu_writeable_ranges[] = {
+    regmap_reg_range(REG_SMPLRT_DIV, REG_ACCEL_CONFIG),
+    regmap_reg_range(REG_MOT_THR, REG_MOT_DUR),
+    regmap_reg_range(REG_FIFO_EN, REG_FIFO_EN),
+    regmap_reg_range(REG_INT_PIN_CFG, REG_INT_ENABLE),
+    regmap_reg_range(REG_USER_CTRL, REG_PWR_MGMT_2),
+    regmap_reg_range(REG_FIFO_R_W, REG_FIFO_R_W),
+};
+
+static const struct regmap_range mpu_precious_ranges[] = {
+    regmap_reg_range(REG_INT_STATUS, REG_INT_STATUS),
+    regmap_reg_range(REG_FIFO_R_W, REG_FIFO_R_W),
+};
+
+static const struct regmap_access_table mpu_volatile_table = {
+    .yes_ranges = mpu_volatile_ranges,
+    .n_yes_ranges = ARRAY_SIZE(mpu_volatile_ranges),
+};
+
+static const struct regmap_access_table mpu_writeable_table = {
+    .yes_ranges = mpu_writeable_ranges,
+    .n_yes_ranges = ARRAY_SIZE(mpu_writeable_ranges),
+};
+
+static const struct regmap_access_table mpu_precious_table = {
+    .yes_ranges = mpu_precious_ranges,
+    .n_yes_ranges = ARRAY_SIZE(mpu_precious_ranges),
+};
+
+static const struct regmap_access_table mpu_noinc_table = {
+    .yes_ranges = &mpu_precious_ranges[1],
+    .n_yes_ranges = 1,
+};
+
+static const struct regmap_config mpu_regmap_config = {
+    .reg_bits = 8,
+    .val_bits = 8,
+    .max_register = REG_WHO_AM_I,
+    .wr_table = &mpu_writeable_table,
+    .volatile_table = &mpu_volatile_table,
+    .precious_table = &mpu_precious_table,
+    .rd_noinc_table = &mpu_noinc_table,
+    .cache_type = REGCACHE_RBTREE,
+};
+
+/* helper: read 8-bit reg; cached config registers cost no bus time */
+static int mpu_read_reg(struct mpu_dev *md, u8 reg)
+{
+    unsigned int val;
+    int ret;
+
+    if (md->dead)
+        return -ENODEV;
+    ret = regmap_read(md->regmap, reg, &val);
+    return ret ? ret : val;
+}
+
+/* helper: write 8-bit reg */
+static int mpu_write_reg(struct mpu_dev *md, u8 reg, u8 val)
+{
+    if (md->dead)
+        return -ENODEV;
+    return regmap_write(md->regmap, reg, val);
+}
+
+/* helper: read len bytes starting at reg in a single bus transaction */
+static int mpu_read_block(struct mpu_dev *md, u8 reg, u8 *buf, u8 len)
+{
+    unsigned int tries = 0;
+    ktime_t t0;
+    int ret;
+
+    if (md->dead)
+        return -ENODEV;
+    for (;;) {
+        t0 = ktime_get();
+        ret = regmap_bulk_read(md->regmap, reg, buf, len);
+        mpu_hist_add(&md->stats.bus, ktime_to_ns(ktime_sub(ktime_get(), t0)));
+        if (!ret || tries++ >= READ_ONCE(bus_retries))
+            break;
+        atomic_long_inc(&md->stats.retries);
+    }
+    if (ret)
+        atomic_long_inc(&md->stats.errors);
+    return ret;
+}
+
+/* helper: drain len bytes from a FIFO port register (no 32-byte SMBus limit on plain I2C) */
+static int mpu_read_long(struct mpu_dev *md, u8 reg, u8 *buf, u16 len)
+{
+    unsigned int tries = 0;
+    ktime_t t0;
+    int ret;
+
+    if (md->dead)
+        return -ENODEV;
+    for (;;) {
+        t0 = ktime_get();
+        ret = regmap_noinc_read(md->regmap, reg, buf, len);
+        mpu_hist_add(&md->stats.bus, ktime_to_ns(ktime_sub(ktime_get(), t0)));
+        if (!ret || tries++ >= READ_ONCE(bus_retries))
+            break;
+        atomic_long_inc(&md->stats.retries);
+    }
+    if (ret)
+        atomic_long_inc(&md->stats.errors);
+    return ret;
+}
+
+/* output data rate: 8 kHz gyro clock with DLPF off (0/7), 1 kHz otherwise */
+static u16 mpu_calc_odr(u8 smplrt_div, u8 dlpf_cfg)
+{
+    u32 base = (dlpf_cfg == 0 || dlpf_cfg == 7) ? 8000 : 1000;
+    return base / (1 + smplrt_div);
+}
+
+/* build a record from one big-endian frame (burst or FIFO). Caller holds md->lock. */
+static void mpu_fill_sample(struct mpu_dev *md, struct mpu_sample *s, const u8 *raw, u64 ts)
+{
+    int i;
+
+    memset(s, 0, sizeof(*s));
+    s->hdr.version = MPU_REC_VERSION;
+    s->hdr.size = sizeof(*s);
+    s->hdr.seq = md->seq++;
+    s->hdr.timestamp_ns = ts;
+    s->hdr.chan_mask = MPU_CHAN_ALL;
+    s->hdr.odr_hz = md->odr_hz;
+    s->hdr.accel_fs = md->cfg.accel_fs;
+    s->hdr.gyro_fs = md->cfg.gyro_fs;
+    if (md->cfg_changed) {
+        s->hdr.flags |= MPU_REC_F_CONFIG;
+        md->cfg_changed = false;
+    }
+    if (md->adapt.changed) {
+        s->hdr.flags |= MPU_REC_F_RATE;
+        md->adapt.changed = false;
+    }
+    for (i = 0; i < 3; i++) {
+        s->accel[i] = (s16)((raw[2 * i] << 8) | raw[2 * i + 1]);
+        s->gyro[i]  = (s16)((raw[8 + 2 * i] << 8) | raw[9 + 2 * i]);
+    }
+    s->temp = (s16)((raw[6] << 8) | raw[7]);
+}
+
+/* ---------- channel rate groups ---------- */
+/*
+ * MPU_IOC_SET_CHAN_RATES splits the channels into accel/temp/gyro rate
+ * groups: bursts shrink to the span of groups due at that instant, slow
+ * groups stay out of the FIFO frame and are read on their own schedule,
+ * and every record repeats their cached value with hdr.chan_mask telling
+ * which channels are fresh. sysfs temp is served from that cache too.
+ */
+static const u16 mpu_grp_chans[MPU_NGRP] = { MPU_CHAN_ACCEL, MPU_CHAN_TEMP, MPU_CHAN_GYRO };
+
+/* MPU_CHAN_* bits of a group set */
+static u16 mpu_grp_mask(unsigned int grps)
+{
+    u16 mask = 0;
+    int g;
+
+    for (g = 0; g < MPU_NGRP; g++)
+        if (grps & BIT(g))
+            mask |= mpu_grp_chans[g];
+    return mask;
+}
+
+/* forget the cache after anything that changes what the registers mean */
+static void mpu_chan_invalidate(struct mpu_dev *md)
+{
+    memset(md->chan.last_ns, 0, sizeof(md->chan.last_ns));
+}
+
+/*
+ * Groups that have to be read at ts, half a sample period early at most so
+ * a group paced at the ODR does not slip a tick on jitter. With none due
+ * the fastest group is read anyway. Caller holds md->lock.
+ */
+static unsigned int mpu_chan_due(struct mpu_dev *md, u64 ts)
+{
+    u32 slack = NSEC_PER_SEC / 2 / md->odr_hz;
+    unsigned int due = 0;
+    int g, fast = 0;
+
+    for (g = 0; g < MPU_NGRP; g++) {
+        if (!md->chan.hz[g] || !md->chan.last_ns[g] ||
+            ts - md->chan.last_ns[g] + slack >= NSEC_PER_SEC / md->chan.hz[g])
+            due |= BIT(g);
+        if (md->chan.hz[g] > md->chan.hz[fast] || !md->chan.hz[g])
+            fast = g;
+    }
+    return due ? due : BIT(fast);
+}
+
+/* rate-0 groups go into the FIFO; all of them if every group is slowed down */
+static void mpu_chan_fifo_layout(struct mpu_dev *md)
+{
+    int g;
+
+    md->chan.fifo_grps = 0;
+    md->chan.frame_len = 0;
+    for (g = 0; g < MPU_NGRP; g++)
+        if (!md->chan.hz[g])
+            md->chan.fifo_grps |= BIT(g);
+    if (!md->chan.fifo_grps)
+        md->chan.fifo_grps = BIT(MPU_NGRP) - 1;
+    for (g = 0; g < MPU_NGRP; g++)
+        if (md->chan.fifo_grps & BIT(g))
+            md->chan.frame_len += mpu_grp_len[g];
+}
+
+/*
+ * One burst over the span of the groups due now, into the cache. TEMP sits
+ * between ACCEL and GYRO, so it is only left out when one of them is too.
+ * Returns the groups read. Caller holds md->lock.
+ */
+static int mpu_chan_read(struct mpu_dev *md, unsigned int due, u64 ts)
+{
+    int first = __ffs(due), last = __fls(due);
+    int off = mpu_grp_off[first], len = mpu_grp_off[last] + mpu_grp_len[last] - off;
+    int g, ret;
+
+    ret = mpu_read_block(md, REG_ACCEL_XOUT_H + off, md->chan.cache + off, len);
+    trace_mpu6050_acq_end(md->minor, ret ? 0 : len, ret);
+    if (ret)
+        return ret;
+    for (g = first; g <= last; g++)
+        md->chan.last_ns[g] = ts;
+    return GENMASK(last, first);
+}
+
+/*
+ * Read the channels due now with one burst from ACCEL_XOUT_H and fill a
+ * self-describing record, the others from the cache. Caller holds md->lock.
+ */
+static int mpu_burst_read(struct mpu_dev *md, struct mpu_sample *s)
+{
+    u64 ts;
+    int ret;
+
+    trace_mpu6050_acq_start(md->minor, READ_ONCE(md->mode));
+    ts = ktime_get_ns();
+    ret = mpu_chan_read(md, mpu_chan_due(md, ts), ts);
+    if (ret < 0)
+        return ret;
+    mpu_fill_sample(md, s, md->chan.cache, ts);
+    s->hdr.chan_mask = mpu_grp_mask(ret);
+    return 0;
+}
+
+static int mpu_set_chan_rates(struct mpu_dev *md, const struct mpu_chan_rates *c)
+{
+    int ret = 0;
+
+    mutex_lock(&md->lock);
+    /* frames already in the FIFO have the old layout */
+    if (md->stream.enabled)
+        mpu_fifo_drain(md);
+    md->chan.hz[MPU_GRP_ACCEL] = c->accel_hz;
+    md->chan.hz[MPU_GRP_TEMP] = c->temp_hz;
+    md->chan.hz[MPU_GRP_GYRO] = c->gyro_hz;
+    mpu_chan_invalidate(md);
+    if (md->stream.enabled)
+        ret = mpu_fifo_reset(md);
+    mutex_unlock(&md->lock);
+    return ret;
+}
+
+static void mpu_get_chan_rates(struct mpu_dev *md, struct mpu_chan_rates *out)
+{
+    memset(out, 0, sizeof(*out));
+    mutex_lock(&md->lock);
+    out->accel_hz = md->chan.hz[MPU_GRP_ACCEL];
+    out->temp_hz = md->chan.hz[MPU_GRP_TEMP];
+    out->gyro_hz = md->chan.hz[MPU_GRP_GYRO];
+    mutex_unlock(&md->lock);
+}
+
+/* raw TEMP_OUT if the temp group is rate-limited and read within its period */
+static bool mpu_chan_temp_cached(struct mpu_dev *md, s16 *raw)
+{
+    struct mpu_chan *c = &md->chan;
+    bool fresh;
+
+    mutex_lock(&md->lock);
+    fresh = c->hz[MPU_GRP_TEMP] && c->last_ns[MPU_GRP_TEMP] &&
+            ktime_get_ns() - c->last_ns[MPU_GRP_TEMP] < NSEC_PER_SEC / c->hz[MPU_GRP_TEMP];
+    if (fresh)
+        *raw = (s16)((c->cache[6] << 8) | c->cache[7]);
+    mutex_unlock(&md->lock);
+    return fresh;
+}
+
+/* ---------- sample ring ---------- */
+/*
+ * Every acquired sample is published once here; readers can mmap() the
+ * ring and consume it without syscalls (layout in struct mpu_ring_hdr).
+ */
+static int mpu_ring_alloc(struct mpu_dev *md, unsigned int nr)
+{
+    size_t data;
+
+    nr = roundup_pow_of_two(clamp(nr, 2U, 1U << 20));
+    data = PAGE_ALIGN((size_t)nr * sizeof(struct mpu_sample));
+    md->ring.size = PAGE_SIZE + data;
+    md->ring.mem = vmalloc_user(md->ring.size);
+    if (!md->ring.mem)
+        return -ENOMEM;
+
+    md->ring.hdr = md->ring.mem;
+    md->ring.slots = md->ring.mem + PAGE_SIZE;
+    md->ring.mask = nr - 1;
+    md->ring.hdr->version = MPU_RING_VERSION;
+    md->ring.hdr->slot_size = sizeof(struct mpu_sample);
+    md->ring.hdr->nr_slots = nr;
+    md->ring.hdr->data_offset = PAGE_SIZE;
+    return 0;
+}
+
+/*
+ * Publish one sample to every consumer. Caller holds md->lock, which makes
+ * this the single ring producer. The smp_wmb orders the previous head
+ * store before the slot is overwritten, the release orders the slot
+ * before the new head (see the protocol in mpu6050_uapi.h).
+ */
+static void mpu_publish(struct mpu_dev *md, const struct mpu_sample *s)
+{
+    struct mpu_ring_hdr *hdr = md->ring.hdr;
+    u32 head = hdr->head;
+
+    smp_wmb();
+    md->ring.slots[head & md->ring.mask] = *s;
+    smp_store_release(&hdr->head, head + 1);
+    WRITE_ONCE(hdr->latest, head);
+    trace_mpu6050_push(md->minor, s->hdr.seq, head, s->hdr.timestamp_ns);
+
+    write_seqcount_begin(&md->snap.seq);
+    md->snap.s = *s;
+    write_seqcount_end(&md->snap.seq);
+
+    if (md->pm.wake_ns) {
+        s64 lat = ktime_get_ns() - md->pm.wake_ns;
+
+        mpu_hist_add(&md->stats.wake, lat);
+        WRITE_ONCE(md->pm.last_wake_us, div_u64(lat, NSEC_PER_USEC));
+        md->pm.wake_ns = 0;
+    }
+
+    mpu_capture_push(md, s);
+    mpu_iio_push(md, s);
+    mpu_input_push(md, s);
+}
+
+/* ---------- decimation filters ---------- */
+/*
+ * MPU_IOC_SET_FILTER puts a boxcar, CIC or Q15 FIR filter with decimation
+ * between streamed acquisition (FIFO, DRDY, TIMER) and publishing, so the
+ * sensor can run at 1 kHz while readers only see e.g. 50 Hz records.
+ */
+static void mpu_sample_get(const struct mpu_sample *s, s32 *v)
+{
+    v[0] = s->accel[0];
+    v[1] = s->accel[1];
+    v[2] = s->accel[2];
+    v[3] = s->temp;
+    v[4] = s->gyro[0];
+    v[5] = s->gyro[1];
+    v[6] = s->gyro[2];
+}
+
+static void mpu_sample_set(struct mpu_sample *s, const s32 *v)
+{
+    s->accel[0] = clamp_t(s32, v[0], S16_MIN, S16_MAX);
+    s->accel[1] = clamp_t(s32, v[1], S16_MIN, S16_MAX);
+    s->accel[2] = clamp_t(s32, v[2], S16_MIN, S16_MAX);
+    s->temp     = clamp_t(s32, v[3], S16_MIN, S16_MAX);
+    s->gyro[0]  = clamp_t(s32, v[4], S16_MIN, S16_MAX);
+    s->gyro[1]  = clamp_t(s32, v[5], S16_MIN, S16_MAX);
+    s->gyro[2]  = clamp_t(s32, v[6], S16_MIN, S16_MAX);
+}
+
+static void mpu_filter_reset(struct mpu_filter *f)
+{
+    memset(&f->st, 0, sizeof(f->st));
+}
+
+static bool mpu_filter_active(const struct mpu_filter *f)
+{
+    return f->cfg.type != MPU_FILTER_NONE || f->cfg.decim > 1;
+}
+
+static void mpu_filter_in(struct mpu_filter *f, const s32 *v)
+{
+    struct mpu_filter_state *st = &f->st;
+    int c, k;
+
+    switch (f->cfg.type) {
+    case MPU_FILTER_BOXCAR:
+        for (c = 0; c < MPU_NCHAN; c++)
+            st->sum[c] += v[c];
+        break;
+    case MPU_FILTER_CIC:
+        for (c = 0; c < MPU_NCHAN; c++) {
+            st->integ[0][c] += (s64)v[c];
+            for (k = 1; k < f->cfg.stages; k++)
+                st->integ[k][c] += st->integ[k - 1][c];
+        }
+        break;
+    case MPU_FILTER_FIR:
+        for (c = 0; c < MPU_NCHAN; c++)
+            st->hist[st->pos][c] = v[c];
+        st->pos = (st->pos + 1) % f->cfg.ntaps;
+        break;
+    }
+}
+
+/* one output from the block just completed; v holds its newest input */
+static void mpu_filter_out(struct mpu_filter *f, s32 *v)
+{
+    struct mpu_filter_state *st = &f->st;
+    unsigned int i, idx;
+    int c, k;
+    s64 acc;
+    u64 x, y;
+
+    switch (f->cfg.type) {
+    case MPU_FILTER_BOXCAR:
+        for (c = 0; c < MPU_NCHAN; c++) {
+            v[c] = DIV_ROUND_CLOSEST(st->sum[c], (s32)f->cfg.decim);
+            st->sum[c] = 0;
+        }
+        break;
+    case MPU_FILTER_CIC:
+        for (c = 0; c < MPU_NCHAN; c++) {
+            x = st->integ[f->cfg.stages - 1][c];
+            for (k = 0; k < f->cfg.stages; k++) {
+                y = x - st->comb[k][c];
+                st->comb[k][c] = x;
+                x = y;
+            }
+            v[c] = div64_s64((s64)x, f->gain);
+        }
+        break;
+    case MPU_FILTER_FIR:
+        /* taps[0] weighs the newest sample */
+        for (c = 0; c < MPU_NCHAN; c++) {
+            acc = 0;
+            for (i = 0; i < f->cfg.ntaps; i++) {
+                idx = (st->pos + f->cfg.ntaps - 1 - i) % f->cfg.ntaps;
+                acc += (s32)f->cfg.taps[i] * st->hist[idx][c];
+            }
+            v[c] = (acc + (1 << 14)) >> 15;
+        }
+        break;
+    }
+}
+
+/*
+ * Feed one streamed sample through the filter and publish when a block of
+ * decim inputs is complete. The record keeps the newest input's header,
+ * with flags from the whole block and the output rate in odr_hz. A gap or
+ * range change restarts the history. Caller holds md->lock.
+ */
+static void mpu_filter_push(struct mpu_dev *md, struct mpu_sample *s)
+{
+    struct mpu_filter *f = &md->filter;
+    s32 v[MPU_NCHAN];
+
+    mpu_adapt_feed(md, s);
+    if (!mpu_filter_active(f)) {
+        mpu_publish(md, s);
+        return;
+    }
+
+    if (s->hdr.flags & (MPU_REC_F_GAP | MPU_REC_F_CONFIG))
+        mpu_filter_reset(f);
+    f->st.flags |= s->hdr.flags;
+    mpu_sample_get(s, v);
+    mpu_filter_in(f, v);
+    if (++f->st.n < f->cfg.decim)
+        return;
+    f->st.n = 0;
+
+    mpu_filter_out(f, v);
+    mpu_sample_set(s, v);
+    s->hdr.flags = f->st.flags;
+    s->hdr.odr_hz = max(1, s->hdr.odr_hz / f->cfg.decim);
+    f->st.flags = 0;
+    mpu_publish(md, s);
+}
+
+static int mpu_set_filter(struct mpu_dev *md, const struct mpu_filter_cfg *c)
+{
+    s64 gain = 1;
+    int k;
+
+    if (c->type > MPU_FILTER_FIR || !c->decim || c->decim > MPU_FILTER_MAX_DECIM)
+        return -EINVAL;
+    if (c->type == MPU_FILTER_CIC && (!c->stages || c->stages > MPU_CIC_MAX_STAGES))
+        return -EINVAL;
+    if (c->type == MPU_FILTER_FIR && (!c->ntaps || c->ntaps > MPU_FIR_MAX_TAPS))
+        return -EINVAL;
+    if (c->type == MPU_FILTER_CIC)
+        for (k = 0; k < c->stages; k++)
+            gain *= c->decim;
+
+    mutex_lock(&md->lock);
+    md->filter.cfg = *c;
+    md->filter.gain = gain;
+    mpu_filter_reset(&md->filter);
+    mutex_unlock(&md->lock);
+    return 0;
+}
+
+/* ---------- runtime PM ---------- */
+/*
+ * The sensor sleeps once the last user is gone (after
+ * power/autosuspend_delay_ms); the first open wakes it and readers never
+ * see data from the warmup_ms gyro start-up window. wake_latency_us is the
+ * time from that wake to the first published sample. Resume restores the
+ * whole configuration with one regcache_sync().
+ */
+
+/* sleep out the rest of the start-up window so no reader sees settling data */
+static void mpu_warmup_wait(struct mpu_dev *md)
+{
+    s64 left = (s64)(READ_ONCE(md->pm.ready_ns) - ktime_get_ns());
+
+    if (left > 0)
+        fsleep(div_u64(left, NSEC_PER_USEC) + 1);
+}
+
+/* wait for the bring-up work; everything that touches the bus goes through here */
+static int mpu_wait_ready(struct mpu_dev *md, bool nonblock)
+{
+    if (!completion_done(&md->boot.done)) {
+        if (nonblock)
+            return -EAGAIN;
+        if (wait_for_completion_interruptible(&md->boot.done))
+            return -ERESTARTSYS;
+    }
+    return md->boot.err;
+}
+
+/* keep the sensor awake for one bus user (file, IIO buffer, sysfs read) */
+static int mpu_pm_get(struct mpu_dev *md)
+{
+    int ret = mpu_wait_ready(md, false);
+
+    return ret ? ret : pm_runtime_resume_and_get(&md->client->dev);
+}
+
+static void mpu_pm_put(struct mpu_dev *md)
+{
+    pm_runtime_mark_last_busy(&md->client->dev);
+    pm_runtime_put_autosuspend(&md->client->dev);
+}
+
+/*
+ * Config writes while asleep only land in the register cache; resume
+ * replays them (and everything else, in case system sleep cut power).
+ */
+static int mpu_runtime_suspend(struct device *dev)
+{
+    struct mpu_dev *md = dev_get_drvdata(dev);
+    int ret;
+
+    mutex_lock(&md->lock);
+    ret = mpu_write_reg(md, REG_PWR_MGMT_1, PWR_MGMT_1_SLEEP);
+    if (!ret && !md->dead) {
+        regcache_cache_only(md->regmap, true);
+        regcache_mark_dirty(md->regmap);
+    }
+    mutex_unlock(&md->lock);
+    return ret;
+}
+
+static int mpu_runtime_resume(struct device *dev)
+{
+    struct mpu_dev *md = dev_get_drvdata(dev);
+    u64 t0 = ktime_get_ns();
+    int ret;
+
+    mutex_lock(&md->lock);
+    if (!md->dead)
+        regcache_cache_only(md->regmap, false);
+    ret = mpu_write_reg(md, REG_PWR_MGMT_1, 0x00);
+    if (!ret)
+        ret = regcache_sync(md->regmap);
+    if (!ret) {
+        mpu_chan_invalidate(md);
+        md->pm.wake_ns = t0;
+        WRITE_ONCE(md->pm.ready_ns, ktime_get_ns() +
+                   (u64)READ_ONCE(md->pm.warmup_ms) * NSEC_PER_MSEC);
+    }
+    mutex_unlock(&md->lock);
+    return ret;
+}
+
+static DEFINE_RUNTIME_DEV_PM_OPS(mpu_pm_ops, mpu_runtime_suspend, mpu_runtime_resume, NULL);
+
+/* ---------- FIFO streaming ---------- */
+/*
+ * MPU_MODE_FIFO drains the on-chip FIFO in bulk from a worker. Frames are
+ * spaced by the sensor's sample clock, whose real period is learned from
+ * drain to drain (sysfs sample_clock_ppm).
+ */
+/* restart the on-chip FIFO with frames of the rate-0 groups. Caller holds md->lock. */
+static int mpu_fifo_reset(struct mpu_dev *md)
+{
+    static const u8 grp_fifo_en[MPU_NGRP] = { FIFO_EN_ACCEL, FIFO_EN_TEMP, FIFO_EN_GYRO };
+    u8 en = 0;
+    int g, ret;
+
+    mpu_chan_fifo_layout(md);
+    for (g = 0; g < MPU_NGRP; g++)
+        if (md->chan.fifo_grps & BIT(g))
+            en |= grp_fifo_en[g];
+    ret = mpu_write_reg(md, REG_USER_CTRL, 0);
+    if (!ret) ret = mpu_write_reg(md, REG_USER_CTRL, USER_CTRL_FIFO_RESET);
+    if (!ret) ret = mpu_write_reg(md, REG_FIFO_EN, en);
+    if (!ret) ret = mpu_write_reg(md, REG_USER_CTRL, USER_CTRL_FIFO_EN);
+    if (!ret) ret = mpu_read_reg(md, REG_INT_STATUS); /* clear stale overflow */
+    md->stream.ts_valid = false;
+    return ret < 0 ? ret : 0;
+}
+
+/* SMPLRT_DIV period as the datasheet gives it, ns << 16 */
+static u64 mpu_nominal_period_q16(struct mpu_dev *md)
+{
+    u32 base = mpu_calc_odr(0, md->cfg.dlpf);
+
+    return div_u64(((u64)(1 + md->cfg.smplrt_div) * NSEC_PER_SEC) << 16, base);
+}
+
+/*
+ * Stamps for n frames drained at now: frame i gets
+ * base + (i + 1) * period, and the return value is base.
+ *
+ * The first batch after a reset ends at now at the nominal period. After
+ * that the period is learned as drain-to-drain time over frame count
+ * (EWMA 1/16, within 1/16 of nominal), which follows the drift of the
+ * sensor's oscillator, and frames continue evenly from the previous batch.
+ * The newest frame is pulled 1/8 of the way towards half a period before
+ * now each batch, but never past now; off by more than that allows means
+ * we lost sync and start over from now. Caller holds md->lock.
+ */
+static u64 mpu_fifo_stamp(struct mpu_dev *md, int n, u64 now)
+{
+    struct mpu_stream *st = &md->stream;
+    u64 nominal = mpu_nominal_period_q16(md);
+    u64 meas, period, span, base;
+    s64 err;
+
+    if (!st->ts_valid) {
+        st->period_q16 = nominal;
+        goto anchor;
+    }
+
+    meas = div_u64((now - st->last_drain) << 16, n);
+    if (meas > nominal - (nominal >> 4) && meas < nominal + (nominal >> 4))
+        st->period_q16 += ((s64)meas - (s64)st->period_q16) / 16;
+
+    period = st->period_q16 >> 16;
+    span = (n * st->period_q16) >> 16;
+    err = now - (st->last_ts + span);
+    if (err <= -(s64)period || err > 2 * (s64)period)
+        goto anchor;
+    base = st->last_ts + min_t(s64, (err - (s64)period / 2) / 8, err);
+    goto out;
+
+anchor:
+    span = (n * st->period_q16) >> 16;
+    base = now - span;
+    /* never step back behind frames already handed out */
+    if (st->ts_valid && base < st->last_ts)
+        base = st->last_ts;
+out:
+    st->ts_valid = true;
+    st->last_ts = base + span;
+    st->last_drain = now;
+    return base;
+}
+
+/*
+ * Publish every complete frame in the on-chip FIFO, stamped by
+ * mpu_fifo_stamp(). Caller holds md->lock.
+ */
+static void mpu_fifo_drain(struct mpu_dev *md)
+{
+    struct mpu_sample s;
+    struct mpu_chan *c = &md->chan;
+    u8 cnt_raw[2], slow_raw[MPU_BURST_LEN];
+    unsigned int slow;
+    const u8 *frame;
+    u64 now, base;
+    int st, n, i, j, k, g, ret;
+    u16 fresh;
+
+    trace_mpu6050_acq_start(md->minor, MPU_MODE_FIFO);
+    st = mpu_read_reg(md, REG_INT_STATUS);
+    if (st >= 0 && (st & INT_FIFO_OFLOW)) {
+        /* frame alignment is lost once the FIFO wraps */
+        md->stream.hw_overflows++;
+        md->stream.gap = true;
+        WRITE_ONCE(md->ring.hdr->overruns, md->ring.hdr->overruns + 1);
+        mpu_fifo_reset(md);
+        trace_mpu6050_acq_end(md->minor, 0, -EOVERFLOW);
+        return;
+    }
+    ret = mpu_read_block(md, REG_FIFO_COUNTH, cnt_raw, 2);
+    n = ret ? 0 : ((cnt_raw[0] << 8) | cnt_raw[1]) / c->frame_len;
+    if (!n) {
+        trace_mpu6050_acq_end(md->minor, 0, ret);
+        return;
+    }
+    now = ktime_get_ns();
+    base = mpu_fifo_stamp(md, n, now);
+
+    /* slow groups are read directly and belong to the newest frame */
+    slow = mpu_chan_due(md, now) & ~c->fifo_grps;
+    for (g = 0; g < MPU_NGRP; g++)
+        if ((slow & BIT(g)) && mpu_read_block(md, REG_ACCEL_XOUT_H + mpu_grp_off[g],
+                                              slow_raw + mpu_grp_off[g], mpu_grp_len[g]))
+            slow &= ~BIT(g);
+
+    for (i = 0; i < n; ) {
+        k = min(n - i, MPU_FIFO_CHUNK_FRAMES);
+        ret = mpu_read_long(md, REG_FIFO_R_W, md->stream.chunk, k * c->frame_len);
+        if (ret) {
+            md->stream.gap = true;
+            WRITE_ONCE(md->ring.hdr->errors, md->ring.hdr->errors + 1);
+            mpu_fifo_reset(md);
+            trace_mpu6050_acq_end(md->minor, i * c->frame_len, ret);
+            return;
+        }
+        for (j = 0; j < k; j++, i++) {
+            /* spread the frame over the cache in burst layout */
+            frame = md->stream.chunk + j * c->frame_len;
+            for (g = 0; g < MPU_NGRP; g++) {
+                if (c->fifo_grps & BIT(g)) {
+                    memcpy(c->cache + mpu_grp_off[g], frame, mpu_grp_len[g]);
+                    frame += mpu_grp_len[g];
+                } else if (i == n - 1 && (slow & BIT(g))) {
+                    memcpy(c->cache + mpu_grp_off[g], slow_raw + mpu_grp_off[g], mpu_grp_len[g]);
+                    c->last_ns[g] = now;
+                }
+            }
+            fresh = mpu_grp_mask(c->fifo_grps | (i == n - 1 ? slow : 0));
+            mpu_fill_sample(md, &s, c->cache,
+                            base + (((u64)(i + 1) * md->stream.period_q16) >> 16));
+            s.hdr.chan_mask = fresh;
+            if (md->stream.gap)
+                s.hdr.flags |= MPU_REC_F_GAP;
+            mpu_filter_push(md, &s);
+            md->stream.gap = false;
+        }
+    }
+    trace_mpu6050_acq_end(md->minor, n * c->frame_len, 0);
+}
+
+/* poll before the hw FIFO is half full, or sooner if the watermark needs it */
+static unsigned long mpu_stream_period(struct mpu_dev *md)
+{
+    u32 frames = min_t(u32, MPU_HW_FIFO_SIZE / md->chan.frame_len / 2,
+                       READ_ONCE(md->stream.watermark));
+
+    return max(1UL, msecs_to_jiffies(frames * 1000 / md->odr_hz));
+}
+
+static void mpu_stream_work(struct work_struct *work)
+{
+    struct mpu_dev *md = container_of(to_delayed_work(work), struct mpu_dev, stream.work);
+
+    mpu_bus_lock(md);
+    if (!md->stream.enabled) {
+        mutex_unlock(&md->lock);
+        return;
+    }
+    mpu_fifo_drain(md);
+    mutex_unlock(&md->lock);
+
+    /* each reader checks its own cursor against the watermark */
+    wake_up_interruptible(&md->wq);
+    schedule_delayed_work(&md->stream.work, mpu_stream_period(md));
+}
+
+static int mpu_stream_start(struct mpu_dev *md)
+{
+    int ret = 0;
+
+    /* FIFO_R_W bursts exceed the 32-byte SMBus block limit */
+    if (!md->full_i2c)
+        return -EOPNOTSUPP;
+
+    /* frames from before this would be start-up noise */
+    mpu_warmup_wait(md);
+    mutex_lock(&md->lock);
+    if (!md->stream.enabled) {
+        ret = mpu_fifo_reset(md);
+        if (!ret) {
+            md->stream.gap = false;
+            md->stream.enabled = true;
+            schedule_delayed_work(&md->stream.work, mpu_stream_period(md));
+        }
+    }
+    mutex_unlock(&md->lock);
+    return ret;
+}
+
+static void mpu_stream_stop(struct mpu_dev *md)
+{
+    mutex_lock(&md->lock);
+    if (md->stream.enabled) {
+        md->stream.enabled = false;
+        mpu_write_reg(md, REG_USER_CTRL, 0);
+        mpu_write_reg(md, REG_FIFO_EN, 0);
+    }
+    mutex_unlock(&md->lock);
+    cancel_delayed_work_sync(&md->stream.work);
+}
+
+/* ---------- hrtimer-paced acquisition ---------- */
+/*
+ * MPU_MODE_TIMER paces burst reads with an hrtimer at timer_rate_hz (the
+ * sensor ODR by default) from a dedicated kthread, optionally SCHED_FIFO
+ * (timer_rt=1) and pinned (timer_cpu=N); debugfs stats has the tick to
+ * bus-read jitter histogram and the missed tick count.
+ */
+static u64 mpu_timer_period(struct mpu_dev *md)
+{
+    unsigned int hz = READ_ONCE(md->timer.rate_hz);
+
+    if (!hz)
+        hz = READ_ONCE(md->odr_hz);
+    return div_u64(NSEC_PER_SEC, hz);
+}
+
+/* hard irq: post the deadline and wake the reader thread, nothing else */
+static enum hrtimer_restart mpu_timer_fire(struct hrtimer *t)
+{
+    struct mpu_dev *md = container_of(t, struct mpu_dev, timer.timer);
+    u64 due = ktime_to_ns(hrtimer_get_expires(t));
+    u64 missed;
+
+    /* previous tick still unserved, plus any periods the timer itself slipped */
+    missed = atomic64_xchg(&md->timer.due, due) ? 1 : 0;
+    missed += hrtimer_forward_now(t, ns_to_ktime(mpu_timer_period(md))) - 1;
+    if (missed) {
+        atomic_long_add(missed, &md->stats.timer_missed);
+        atomic_add(missed, &md->timer.missed);
+    }
+    wake_up_process(md->timer.thread);
+    return HRTIMER_RESTART;
+}
+
+static void mpu_timer_sample(struct mpu_dev *md, u64 due)
+{
+    struct mpu_sample s;
+    int ret;
+
+    mpu_bus_lock(md);
+    if (!md->timer.running) {
+        mutex_unlock(&md->lock);
+        return;
+    }
+    mpu_hist_add(&md->stats.timer_jitter, ktime_get_ns() - due);
+    ret = mpu_burst_read(md, &s);
+    if (!ret) {
+        if (atomic_xchg(&md->timer.missed, 0))
+            s.hdr.flags |= MPU_REC_F_GAP;
+        mpu_filter_push(md, &s);
+    } else {
+        WRITE_ONCE(md->ring.hdr->errors, md->ring.hdr->errors + 1);
+    }
+    mutex_unlock(&md->lock);
+
+    if (!ret)
+        wake_up_interruptible(&md->wq);
+}
+
+static int mpu_timer_thread(void *data)
+{
+    struct mpu_dev *md = data;
+    u64 due;
+
+    for (;;) {
+        set_current_state(TASK_INTERRUPTIBLE);
+        if (kthread_should_stop())
+            break;
+        due = atomic64_xchg(&md->timer.due, 0);
+        if (!due) {
+            schedule();
+            continue;
+        }
+        __set_current_state(TASK_RUNNING);
+        mpu_timer_sample(md, due);
+    }
+    __set_current_state(TASK_RUNNING);
+    return 0;
+}
+
+/* caller holds mode_lock */
+static int mpu_timer_start(struct mpu_dev *md)
+{
+    struct task_struct *t;
+
+    if (md->timer.thread)
+        return 0;
+
+    mpu_warmup_wait(md);
+    t = kthread_create(mpu_timer_thread, md, DEVICE_NAME "-%d", md->minor);
+    if (IS_ERR(t))
+        return PTR_ERR(t);
+    if (timer_cpu >= 0 && timer_cpu < nr_cpu_ids && cpu_online(timer_cpu))
+        kthread_bind(t, timer_cpu);
+    if (timer_rt)
+        sched_set_fifo(t);
+
+    atomic64_set(&md->timer.due, 0);
+    atomic_set(&md->timer.missed, 0);
+    mutex_lock(&md->lock);
+    md->timer.running = true;
+    mutex_unlock(&md->lock);
+    md->timer.thread = t;
+    wake_up_process(t);
+    hrtimer_start(&md->timer.timer, ktime_add_ns(ktime_get(), mpu_timer_period(md)),
+                  HRTIMER_MODE_ABS_HARD);
+    return 0;
+}
+
+/* caller holds mode_lock */
+static void mpu_timer_stop(struct mpu_dev *md)
+{
+    if (!md->timer.thread)
+        return;
+
+    mutex_lock(&md->lock);
+    md->timer.running = false;
+    mutex_unlock(&md->lock);
+    hrtimer_cancel(&md->timer.timer);
+    kthread_stop(md->timer.thread);
+    md->timer.thread = NULL;
+}
+
+/* ---------- runtime configuration ---------- */
+/*
+ * Output data rate, DLPF and full-scale ranges are set at runtime through
+ * MPU_IOC_SET_CONFIG, sysfs or IIO; every record carries the ranges it was
+ * sampled with.
+ */
+/* write all four config registers. Caller holds md->lock. */
+static int mpu_apply_config(struct mpu_dev *md, const struct mpu_hw_cfg *c)
+{
+    int ret;
+
+    /* frames already in the hw FIFO were taken with the old ranges */
+    if (md->stream.enabled)
+        mpu_fifo_drain(md);
+
+    ret = mpu_write_reg(md, REG_SMPLRT_DIV, c->smplrt_div);
+    if (!ret) ret = mpu_write_reg(md, REG_CONFIG, c->dlpf);
+    if (!ret) ret = mpu_write_reg(md, REG_GYRO_CONFIG, c->gyro_fs << 3);
+    if (!ret) ret = mpu_write_reg(md, REG_ACCEL_CONFIG, c->accel_fs << 3 | ACCEL_HPF_5HZ);
+    if (ret)
+        return ret;
+
+    md->cfg = *c;
+    md->odr_hz = mpu_calc_odr(c->smplrt_div, c->dlpf);
+    md->cfg_changed = true;
+    mpu_chan_invalidate(md);
+    md->stream.ts_valid = false;
+    return 0;
+}
+
+/* SMPLRT_DIV giving the closest rate not above odr_hz */
+static u8 mpu_odr_to_div(u32 odr_hz, u8 dlpf)
+{
+    u32 base = mpu_calc_odr(0, dlpf);
+
+    odr_hz = clamp_t(u32, odr_hz, 1, base);
+    return min_t(u32, DIV_ROUND_UP(base, odr_hz) - 1, 255);
+}
+
+/*
+ * Validate and apply a userspace request; odr_hz 0 keeps the current rate.
+ * On success req is updated with the rate actually programmed.
+ */
+static int mpu_set_config(struct mpu_dev *md, struct mpu_config *req)
+{
+    struct mpu_hw_cfg c;
+    int ret;
+
+    if (req->dlpf > 6 || req->accel_fs > MPU_ACCEL_FS_16G || req->gyro_fs > MPU_GYRO_FS_2000)
+        return -EINVAL;
+    ret = mpu_wait_ready(md, false);
+    if (ret)
+        return ret;
+
+    mutex_lock(&md->lock);
+    c.dlpf = req->dlpf;
+    c.accel_fs = req->accel_fs;
+    c.gyro_fs = req->gyro_fs;
+    c.smplrt_div = mpu_odr_to_div(req->odr_hz ? req->odr_hz : md->odr_hz, c.dlpf);
+    ret = mpu_apply_config(md, &c);
+    req->odr_hz = md->odr_hz;
+    mutex_unlock(&md->lock);
+    return ret;
+}
+
+static void mpu_get_config(struct mpu_dev *md, struct mpu_config *out)
+{
+    memset(out, 0, sizeof(*out));
+    mutex_lock(&md->lock);
+    out->odr_hz = md->odr_hz;
+    out->dlpf = md->cfg.dlpf;
+    out->accel_fs = md->cfg.accel_fs;
+    out->gyro_fs = md->cfg.gyro_fs;
+    mutex_unlock(&md->lock);
+}
+
+/* ---------- adaptive rate ---------- */
+/*
+ * MPU_IOC_SET_ADAPTIVE lets the driver pick the output rate between an
+ * idle and an active rate/DLPF pair; the first record at a new rate
+ * carries MPU_REC_F_RATE and sysfs activity_mg shows the current level.
+ */
+
+/*
+ * Accumulate the energy of the high-passed acceleration (DC tracked with a
+ * 1/16 EMA) and decide once per window: above up_mg go active at once,
+ * below down_mg for hold windows go back to idle. The registers are written
+ * from a work item because this runs inside the FIFO drain. Caller holds
+ * md->lock.
+ */
+static void mpu_adapt_feed(struct mpu_dev *md, const struct mpu_sample *s)
+{
+    struct mpu_adapt *a = &md->adapt;
+    u64 ms, up, down;
+    u32 lsb_per_g;
+    s32 d;
+    int i;
+
+    if (!a->cfg.lo_hz)
+        return;
+    if (!a->primed) {
+        for (i = 0; i < 3; i++)
+            a->mean[i] = s->accel[i] << 4;
+        a->primed = true;
+        a->win_start = s->hdr.timestamp_ns;
+        return;
+    }
+    for (i = 0; i < 3; i++) {
+        d = (s->accel[i] << 4) - a->mean[i];
+        a->mean[i] += d >> 4;
+        d >>= 4;
+        a->energy += (u64)((s64)d * d);
+    }
+    a->n++;
+    if (s->hdr.timestamp_ns - a->win_start < (u64)a->cfg.window_ms * NSEC_PER_MSEC)
+        return;
+
+    lsb_per_g = ACCEL_SENS_2G >> s->hdr.accel_fs;
+    ms = div_u64(a->energy, a->n);
+    a->rms_mg = div_u64((u64)int_sqrt64(ms) * 1000, lsb_per_g);
+    a->energy = 0;
+    a->n = 0;
+    a->win_start = s->hdr.timestamp_ns;
+
+    up = (u64)a->cfg.up_mg * lsb_per_g / 1000;
+    down = (u64)a->cfg.down_mg * lsb_per_g / 1000;
+    if (!a->high && ms > up * up) {
+        a->high = true;
+        a->quiet = 0;
+        schedule_work(&a->work);
+    } else if (a->high && ms < down * down) {
+        if (++a->quiet >= a->cfg.hold) {
+            a->high = false;
+            a->quiet = 0;
+            schedule_work(&a->work);
+        }
+    } else {
+        a->quiet = 0;
+    }
+}
+
+/* program the rate/DLPF pair for the current decision */
+static void mpu_adapt_work(struct work_struct *work)
+{
+    struct mpu_dev *md = container_of(work, struct mpu_dev, adapt.work);
+    struct mpu_adapt *a = &md->adapt;
+    struct mpu_hw_cfg c;
+
+    mutex_lock(&md->lock);
+    if (md->dead || !a->cfg.lo_hz)
+        goto out;
+    c = md->cfg;
+    c.dlpf = a->high ? a->cfg.hi_dlpf : a->cfg.lo_dlpf;
+    c.smplrt_div = mpu_odr_to_div(a->high ? a->cfg.hi_hz : a->cfg.lo_hz, c.dlpf);
+    if (c.dlpf == md->cfg.dlpf && c.smplrt_div == md->cfg.smplrt_div)
+        goto out;
+    if (mpu_apply_config(md, &c))
+        goto out;
+    a->changed = true;
+    a->switches++;
+    /* the new rate starts a fresh window */
+    a->energy = 0;
+    a->n = 0;
+    a->primed = false;
+out:
+    mutex_unlock(&md->lock);
+}
+
+/* lo_hz 0 turns the controller off and leaves the current rate in place */
+static int mpu_set_adaptive(struct mpu_dev *md, const struct mpu_adaptive_cfg *c)
+{
+    struct mpu_adapt *a = &md->adapt;
+
+    if (c->lo_hz) {
+        if (c->hi_hz <= c->lo_hz || c->lo_dlpf > 6 || c->hi_dlpf > 6)
+            return -EINVAL;
+        if (c->hi_hz > mpu_calc_odr(0, c->hi_dlpf) || c->lo_hz > mpu_calc_odr(0, c->lo_dlpf))
+            return -EINVAL;
+        if (c->window_ms < 10 || c->window_ms > 10000 || !c->hold || c->down_mg >= c->up_mg)
+            return -EINVAL;
+    }
+
+    mutex_lock(&md->lock);
+    /* remove() has cancelled the work for good */
+    if (md->dead) {
+        mutex_unlock(&md->lock);
+        return -ENODEV;
+    }
+    a->cfg = *c;
+    a->high = false;
+    a->quiet = 0;
+    a->energy = 0;
+    a->n = 0;
+    a->primed = false;
+    a->rms_mg = 0;
+    mutex_unlock(&md->lock);
+    /* start out idle */
+    if (c->lo_hz)
+        schedule_work(&a->work);
+    return 0;
+}
+
+static void mpu_get_adaptive(struct mpu_dev *md, struct mpu_adaptive_cfg *out)
+{
+    mutex_lock(&md->lock);
+    *out = md->adapt.cfg;
+    mutex_unlock(&md->lock);
+}
+
+/* ---------- data-ready interrupt ---------- */
+/*
+ * With INT wired (client->irq, DT int-gpios, or line irq_gpio=N of
+ * gpio_chip) MPU_MODE_DRDY latches every new sample in a threaded handler,
+ * stamped with the hard irq time.
+ */
+static irqreturn_t mpu_drdy_hardirq(int irq, void *data)
+{
+    struct mpu_dev *md = data;
+
+    WRITE_ONCE(md->drdy.irq_ts, ktime_get_ns());
+    return IRQ_WAKE_THREAD;
+}
+
+/*
+ * Latch the new sample; the burst read also clears the latched INT line.
+ * With the motion detector armed the line has two sources, so INT_STATUS
+ * is read first to tell them apart.
+ */
+static irqreturn_t mpu_drdy_thread(int irq, void *data)
+{
+    struct mpu_dev *md = data;
+    struct mpu_sample s;
+    int st = INT_DATA_RDY;
+
+    mpu_bus_lock(md);
+    if (md->motion.enabled) {
+        st = mpu_read_reg(md, REG_INT_STATUS);
+        if (st < 0)
+            st = 0;
+        if (st & INT_MOT) {
+            md->motion.last_ns = READ_ONCE(md->drdy.irq_ts);
+            WRITE_ONCE(md->motion.count, md->motion.count + 1);
+            wake_up_interruptible(&md->wq);
+        }
+    }
+    /* disarmed, motion only, or still warming up: just clear the latch */
+    if (!md->drdy.enabled || !(st & INT_DATA_RDY) ||
+        READ_ONCE(md->drdy.irq_ts) < md->pm.ready_ns) {
+        if (!md->motion.enabled)
+            mpu_read_reg(md, REG_INT_STATUS);
+        mutex_unlock(&md->lock);
+        return IRQ_HANDLED;
+    }
+    if (!mpu_burst_read(md, &s)) {
+        s.hdr.timestamp_ns = READ_ONCE(md->drdy.irq_ts);
+        mpu_filter_push(md, &s);
+    } else {
+        WRITE_ONCE(md->ring.hdr->errors, md->ring.hdr->errors + 1);
+    }
+    mutex_unlock(&md->lock);
+
+    wake_up_interruptible(&md->wq);
+    return IRQ_HANDLED;
+}
+
+/* INT_ENABLE from both sources. Caller holds md->lock. */
+static int mpu_int_update(struct mpu_dev *md)
+{
+    u8 en = (md->drdy.enabled ? INT_DATA_RDY : 0) | (md->motion.enabled ? INT_MOT : 0);
+    int ret;
+
+    ret = mpu_write_reg(md, REG_INT_ENABLE, en);
+    if (!ret)
+        mpu_read_reg(md, REG_INT_STATUS); /* drop a stale latch */
+    return ret;
+}
+
+static int mpu_drdy_enable(struct mpu_dev *md, bool on)
+{
+    int ret = 0;
+
+    if (!md->drdy.irq)
+        return on ? -ENODEV : 0;
+
+    mutex_lock(&md->lock);
+    if (md->drdy.enabled != on) {
+        md->drdy.enabled = on;
+        ret = mpu_int_update(md);
+        if (ret)
+            md->drdy.enabled = !on;
+    }
+    mutex_unlock(&md->lock);
+    return ret;
+}
+
+/* ---------- motion detection ---------- */
+/*
+ * MPU_IOC_SET_MOTION arms the sensor's motion detector (MOT_THR/MOT_DUR);
+ * each event raises EPOLLPRI on every open file until it fetches it with
+ * MPU_IOC_GET_MOTION_EVENT, so a consumer can sleep in poll() with no bus
+ * traffic and start streaming once something moves.
+ */
+static int mpu_motion_enable(struct mpu_dev *md, bool on)
+{
+    int ret = 0;
+
+    if (!md->drdy.irq)
+        return on ? -ENODEV : 0;
+
+    mutex_lock(&md->lock);
+    if (md->motion.enabled != on) {
+        md->motion.enabled = on;
+        ret = mpu_int_update(md);
+        if (ret)
+            md->motion.enabled = !on;
+    }
+    mutex_unlock(&md->lock);
+    return ret;
+}
+
+/* threshold 0 disarms; armed while any file is open */
+static int mpu_set_motion(struct mpu_dev *md, const struct mpu_motion_cfg *c)
+{
+    u8 thr = DIV_ROUND_UP(c->threshold_mg, MPU_MOT_MG_PER_LSB);
+    int ret;
+
+    /* the INT line is set up by the bring-up work */
+    ret = mpu_wait_ready(md, false);
+    if (ret)
+        return ret;
+    if (!md->drdy.irq)
+        return -ENODEV;
+    if (c->threshold_mg > 255 * MPU_MOT_MG_PER_LSB || (thr && !c->duration_ms))
+        return -EINVAL;
+
+    mutex_lock(&md->mode_lock);
+    mutex_lock(&md->lock);
+    ret = mpu_write_reg(md, REG_MOT_THR, thr);
+    if (!ret)
+        ret = mpu_write_reg(md, REG_MOT_DUR, c->duration_ms);
+    if (!ret) {
+        md->motion.thr = thr;
+        md->motion.dur = c->duration_ms;
+    }
+    mutex_unlock(&md->lock);
+    if (!ret)
+        ret = mpu_motion_enable(md, thr != 0);
+    mutex_unlock(&md->mode_lock);
+    return ret;
+}
+
+static void mpu_get_motion(struct mpu_dev *md, struct mpu_motion_cfg *out)
+{
+    memset(out, 0, sizeof(*out));
+    mutex_lock(&md->lock);
+    out->threshold_mg = md->motion.thr * MPU_MOT_MG_PER_LSB;
+    out->duration_ms = md->motion.dur;
+    mutex_unlock(&md->lock);
+}
+
+static u32 mpu_default_mode(struct mpu_dev *md)
+{
+    return md->drdy.irq ? MPU_MODE_DRDY : MPU_MODE_ONDEMAND;
+}
+
+/* background streaming for in-kernel consumers: INT, else FIFO, else (SMBus only) the hrtimer */
+static u32 mpu_stream_mode(struct mpu_dev *md)
+{
+    if (md->drdy.irq)
+        return MPU_MODE_DRDY;
+    return md->full_i2c ? MPU_MODE_FIFO : MPU_MODE_TIMER;
+}
+
+/* switch acquisition mode; only called with at least one file open */
+static int mpu_set_mode(struct mpu_dev *md, u32 mode)
+{
+    int ret = 0;
+
+    if (mode != MPU_MODE_ONDEMAND && mode != MPU_MODE_FIFO && mode != MPU_MODE_DRDY &&
+        mode != MPU_MODE_TIMER)
+        return -EINVAL;
+    if (mode == MPU_MODE_DRDY && !md->drdy.irq)
+        return -ENODEV;
+    if (READ_ONCE(md->dead))
+        return -ENODEV;
+
+    mutex_lock(&md->mode_lock);
+    if (mode != MPU_MODE_FIFO)
+        mpu_stream_stop(md);
+    if (mode != MPU_MODE_DRDY)
+        mpu_drdy_enable(md, false);
+    if (mode != MPU_MODE_TIMER)
+        mpu_timer_stop(md);
+    if (mode == MPU_MODE_FIFO)
+        ret = mpu_stream_start(md);
+    else if (mode == MPU_MODE_DRDY)
+        ret = mpu_drdy_enable(md, true);
+    else if (mode == MPU_MODE_TIMER)
+        ret = mpu_timer_start(md);
+    WRITE_ONCE(md->mode, ret ? MPU_MODE_ONDEMAND : mode);
+    /* readers and the filter start the new stream fresh */
+    WRITE_ONCE(md->mode_start, smp_load_acquire(&md->ring.hdr->head));
+    mutex_lock(&md->lock);
+    mpu_filter_reset(&md->filter);
+    mutex_unlock(&md->lock);
+    mutex_unlock(&md->mode_lock);
+
+    wake_up_interruptible(&md->wq);
+    return ret;
+}
+
+/*
+ * Every user keeps the sensor awake. The first opener arms the interrupt,
+ * the last closer stops all bus traffic and lets autosuspend run.
+ */
+static int mpu_acq_get(struct mpu_dev *md)
+{
+    int ret;
+
+    ret = mpu_pm_get(md);
+    if (ret)
+        return ret;
+    mutex_lock(&md->mode_lock);
+    if (md->users++ == 0) {
+        if (md->mode == MPU_MODE_DRDY)
+            mpu_drdy_enable(md, true);
+        if (md->motion.thr)
+            mpu_motion_enable(md, true);
+    }
+    mutex_unlock(&md->mode_lock);
+    return 0;
+}
+
+static void mpu_acq_put(struct mpu_dev *md)
+{
+    mutex_lock(&md->mode_lock);
+    if (--md->users == 0) {
+        mpu_stream_stop(md);
+        mpu_drdy_enable(md, false);
+        mpu_motion_enable(md, false);
+        mpu_timer_stop(md);
+        WRITE_ONCE(md->mode, mpu_default_mode(md));
+    }
+    mutex_unlock(&md->mode_lock);
+    mpu_pm_put(md);
+}
+
+/* INT is optional: client->irq from DT/ACPI, else an "int" GPIO (DT or irq_gpio) */
+static int mpu_drdy_setup(struct mpu_dev *md)
+{
+    struct i2c_client *client = md->client;
+    struct gpio_desc *gpiod;
+    int irq = client->irq, ret;
+
+    if (irq <= 0) {
+        gpiod = devm_gpiod_get_optional(&client->dev, "int", GPIOD_IN);
+        if (IS_ERR(gpiod))
+            return PTR_ERR(gpiod);
+        if (!gpiod)
+            return 0;
+        irq = gpiod_to_irq(gpiod);
+        if (irq < 0)
+            return irq;
+    }
+
+    /* latched, cleared by the burst read that consumes the sample */
+    ret = mpu_write_reg(md, REG_INT_PIN_CFG, INT_PIN_LATCH_EN | INT_PIN_RD_CLEAR);
+    if (!ret)
+        ret = mpu_write_reg(md, REG_INT_ENABLE, 0);
+    if (!ret)
+        ret = request_threaded_irq(irq, mpu_drdy_hardirq, mpu_drdy_thread,
+                                   IRQF_TRIGGER_RISING | IRQF_ONESHOT,
+                                   dev_name(&client->dev), md);
+    if (ret)
+        return ret;
+    md->drdy.irq = irq;
+    dev_info(&client->dev, "data-ready interrupt on irq %d\n", md->drdy.irq);
+    return 0;
+}
+
+static void mpu_drdy_teardown(struct mpu_dev *md)
+{
+    if (md->drdy.irq)
+        free_irq(md->drdy.irq, md);
+    md->drdy.irq = 0;
+}
+
+/* ---------- IIO personality ---------- */
+/*
+ * With IIO triggered buffers the sensor is also an IIO device (in_accel_*,
+ * in_anglvel_*, in_temp) with its own per-sample trigger; any other
+ * trigger (e.g. iio-trig-hrtimer) works too.
+ */
+#if IS_ENABLED(CONFIG_IIO_TRIGGERED_BUFFER)
+enum mpu_scan {
+    MPU_SCAN_ACCEL_X, MPU_SCAN_ACCEL_Y, MPU_SCAN_ACCEL_Z,
+    MPU_SCAN_TEMP,
+    MPU_SCAN_GYRO_X, MPU_SCAN_GYRO_Y, MPU_SCAN_GYRO_Z,
+    MPU_SCAN_TS,
+};
+
+/* scan index == word offset from ACCEL_XOUT_H, so the burst span follows the mask */
+#define MPU_IIO_CHAN(_type, _mod, _idx) {                               \
+    .type = _type,                                                      \
+    .modified = 1,                                                      \
+    .channel2 = _mod,                                                   \
+    .address = REG_ACCEL_XOUT_H + 2 * (_idx),                           \
+    .info_mask_separate = BIT(IIO_CHAN_INFO_RAW),                       \
+    .info_mask_shared_by_type = BIT(IIO_CHAN_INFO_SCALE),               \
+    .info_mask_shared_by_type_available = BIT(IIO_CHAN_INFO_SCALE),     \
+    .info_mask_shared_by_all = BIT(IIO_CHAN_INFO_SAMP_FREQ),            \
+    .scan_index = _idx,                                                 \
+    .scan_type = { .sign = 's', .realbits = 16, .storagebits = 16,      \
+                   .endianness = IIO_BE },                              \
+}
+
+static const struct iio_chan_spec mpu_iio_channels[] = {
+    MPU_IIO_CHAN(IIO_ACCEL, IIO_MOD_X, MPU_SCAN_ACCEL_X),
+    MPU_IIO_CHAN(IIO_ACCEL, IIO_MOD_Y, MPU_SCAN_ACCEL_Y),
+    MPU_IIO_CHAN(IIO_ACCEL, IIO_MOD_Z, MPU_SCAN_ACCEL_Z),
+    {
+        .type = IIO_TEMP,
+        .address = REG_TEMP_OUT_H,
+        .info_mask_separate = BIT(IIO_CHAN_INFO_RAW) | BIT(IIO_CHAN_INFO_SCALE) |
+                              BIT(IIO_CHAN_INFO_OFFSET),
+        .info_mask_shared_by_all = BIT(IIO_CHAN_INFO_SAMP_FREQ),
+        .scan_index = MPU_SCAN_TEMP,
+        .scan_type = { .sign = 's', .realbits = 16, .storagebits = 16,
+                       .endianness = IIO_BE },
+    },
+    MPU_IIO_CHAN(IIO_ANGL_VEL, IIO_MOD_X, MPU_SCAN_GYRO_X),
+    MPU_IIO_CHAN(IIO_ANGL_VEL, IIO_MOD_Y, MPU_SCAN_GYRO_Y),
+    MPU_IIO_CHAN(IIO_ANGL_VEL, IIO_MOD_Z, MPU_SCAN_GYRO_Z),
+    IIO_CHAN_SOFT_TIMESTAMP(MPU_SCAN_TS),
+};
+
+/* iio_priv() holds just the back pointer; the state stays in struct mpu_dev */
+static struct mpu_dev *mpu_iio_priv(struct iio_dev *indio_dev)
+{
+    return *(struct mpu_dev **)iio_priv(indio_dev);
+}
+
+static int mpu_iio_read_raw(struct iio_dev *indio_dev, struct iio_chan_spec const *chan,
+                            int *val, int *val2, long mask)
+{
+    struct mpu_dev *md = mpu_iio_priv(indio_dev);
+    u8 raw[2];
+    int ret;
+
+    switch (mask) {
+    case IIO_CHAN_INFO_RAW:
+        ret = mpu_pm_get(md);
+        if (ret)
+            return ret;
+        mpu_warmup_wait(md);
+        mutex_lock(&md->lock);
+        ret = mpu_read_block(md, chan->address, raw, 2);
+        mutex_unlock(&md->lock);
+        mpu_pm_put(md);
+        if (ret)
+            return ret;
+        *val = (s16)((raw[0] << 8) | raw[1]);
+        return IIO_VAL_INT;
+    case IIO_CHAN_INFO_SCALE:
+        switch (chan->type) {
+        case IIO_ACCEL:
+            *val = 0;
+            *val2 = mpu_accel_scale_nano[READ_ONCE(md->cfg.accel_fs)];
+            return IIO_VAL_INT_PLUS_NANO;
+        case IIO_ANGL_VEL:
+            *val = 0;
+            *val2 = mpu_gyro_scale_nano[READ_ONCE(md->cfg.gyro_fs)];
+            return IIO_VAL_INT_PLUS_NANO;
+        case IIO_TEMP:
+            /* 1/340 degC per LSB, in milli degC */
+            *val = 2;
+            *val2 = 941176;
+            return IIO_VAL_INT_PLUS_MICRO;
+        default:
+            return -EINVAL;
+        }
+    case IIO_CHAN_INFO_OFFSET:
+        /* 36.53 degC * 340 LSB/degC */
+        *val = 12420;
+        return IIO_VAL_INT;
+    case IIO_CHAN_INFO_SAMP_FREQ:
+        *val = READ_ONCE(md->odr_hz);
+        return IIO_VAL_INT;
+    default:
+        return -EINVAL;
+    }
+}
+
+/* {int, nano} pairs for the *_scale_available attributes */
+static int mpu_iio_accel_avail[2 * ARRAY_SIZE(mpu_accel_scale_nano)];
+static int mpu_iio_gyro_avail[2 * ARRAY_SIZE(mpu_gyro_scale_nano)];
+
+static int mpu_iio_read_avail(struct iio_dev *indio_dev, struct iio_chan_spec const *chan,
+                              const int **vals, int *type, int *length, long mask)
+{
+    if (mask != IIO_CHAN_INFO_SCALE)
+        return -EINVAL;
+    *type = IIO_VAL_INT_PLUS_NANO;
+    switch (chan->type) {
+    case IIO_ACCEL:
+        *vals = mpu_iio_accel_avail;
+        *length = ARRAY_SIZE(mpu_iio_accel_avail);
+        return IIO_AVAIL_LIST;
+    case IIO_ANGL_VEL:
+        *vals = mpu_iio_gyro_avail;
+        *length = ARRAY_SIZE(mpu_iio_gyro_avail);
+        return IIO_AVAIL_LIST;
+    default:
+        return -EINVAL;
+    }
+}
+
+static int mpu_iio_write_raw(struct iio_dev *indio_dev, struct iio_chan_spec const *chan,
+                             int val, int val2, long mask)
+{
+    struct mpu_dev *md = mpu_iio_priv(indio_dev);
+    struct mpu_config c;
+    int i;
+
+    mpu_get_config(md, &c);
+    switch (mask) {
+    case IIO_CHAN_INFO_SCALE:
+        if (val)
+            return -EINVAL;
+        for (i = 0; i < 4; i++) {
+            if (chan->type == IIO_ACCEL && mpu_accel_scale_nano[i] == val2) {
+                c.accel_fs = i;
+                return mpu_set_config(md, &c);
+            }
+            if (chan->type == IIO_ANGL_VEL && mpu_gyro_scale_nano[i] == val2) {
+                c.gyro_fs = i;
+                return mpu_set_config(md, &c);
+            }
+        }
+        return -EINVAL;
+    case IIO_CHAN_INFO_SAMP_FREQ:
+        if (val <= 0)
+            return -EINVAL;
+        c.odr_hz = min(val, 8000);
+        return mpu_set_config(md, &c);
+    default:
+        return -EINVAL;
+    }
+}
+
+static int mpu_iio_write_raw_get_fmt(struct iio_dev *indio_dev,
+                                     struct iio_chan_spec const *chan, long mask)
+{
+    return mask == IIO_CHAN_INFO_SCALE ? IIO_VAL_INT_PLUS_NANO : IIO_VAL_INT;
+}
+
+static const struct iio_info mpu_iio_info = {
+    .read_raw = mpu_iio_read_raw,
+    .read_avail = mpu_iio_read_avail,
+    .write_raw = mpu_iio_write_raw,
+    .write_raw_get_fmt = mpu_iio_write_raw_get_fmt,
+};
+
+/*
+ * Own trigger: the sample was just acquired, repack it. Any other trigger
+ * reads only the span of registers covering the enabled channels.
+ */
+static irqreturn_t mpu_iio_trigger_handler(int irq, void *p)
+{
+    struct iio_poll_func *pf = p;
+    struct iio_dev *indio_dev = pf->indio_dev;
+    struct mpu_dev *md = mpu_iio_priv(indio_dev);
+    struct {
+        __be16 chan[MPU_SCAN_TS];
+        s64 ts __aligned(8);
+    } scan = { };
+    u8 raw[MPU_BURST_LEN];
+    const struct mpu_sample *s = md->iio.cur;
+    unsigned int first, last, bit, n = 0;
+    s64 ts = pf->timestamp;
+
+    if (iio_trigger_using_own(indio_dev) && s) {
+        s16 words[MPU_SCAN_TS] = {
+            s->accel[0], s->accel[1], s->accel[2], s->temp,
+            s->gyro[0], s->gyro[1], s->gyro[2],
+        };
+
+        for_each_set_bit(bit, indio_dev->active_scan_mask, MPU_SCAN_TS)
+            scan.chan[n++] = cpu_to_be16(words[bit]);
+        /* sample time is CLOCK_MONOTONIC, move it to the IIO clock */
+        ts = s->hdr.timestamp_ns + (iio_get_time_ns(indio_dev) - ktime_get_ns());
+    } else {
+        first = find_first_bit(indio_dev->active_scan_mask, MPU_SCAN_TS);
+        if (first >= MPU_SCAN_TS)
+            goto out;
+        last = find_last_bit(indio_dev->active_scan_mask, MPU_SCAN_TS);
+
+        mpu_warmup_wait(md);
+        mpu_bus_lock(md);
+        if (mpu_read_block(md, REG_ACCEL_XOUT_H + 2 * first, raw, 2 * (last - first + 1))) {
+            mutex_unlock(&md->lock);
+            goto out;
+        }
+        mutex_unlock(&md->lock);
+
+        for_each_set_bit(bit, indio_dev->active_scan_mask, MPU_SCAN_TS)
+            memcpy(&scan.chan[n++], &raw[2 * (bit - first)], 2);
+    }
+    iio_push_to_buffers_with_timestamp(indio_dev, &scan, ts);
+out:
+    iio_trigger_notify_done(indio_dev->trig);
+    return IRQ_HANDLED;
+}
+
+/* our trigger fires per published sample, so make sure acquisition runs */
+static int mpu_iio_set_trigger_state(struct iio_trigger *trig, bool state)
+{
+    struct mpu_dev *md = mpu_iio_priv(iio_trigger_get_drvdata(trig));
+    int ret = 0;
+
+    if (state) {
+        ret = mpu_acq_get(md);
+        if (ret)
+            return ret;
+        if (READ_ONCE(md->mode) == MPU_MODE_ONDEMAND)
+            ret = mpu_set_mode(md, mpu_stream_mode(md));
+        if (ret) {
+            mpu_acq_put(md);
+            return ret;
+        }
+    }
+    WRITE_ONCE(md->iio.trig_on, state);
+    if (!state)
+        mpu_acq_put(md);
+    return 0;
+}
+
+static const struct iio_trigger_ops mpu_iio_trigger_ops = {
+    .set_trigger_state = mpu_iio_set_trigger_state,
+    .validate_device = iio_trigger_validate_own_device,
+};
+
+/*
+ * Any trigger, ours or e.g. iio-trig-hrtimer: an enabled buffer keeps the
+ * sensor out of runtime suspend, or its bursts would hit a sleeping chip.
+ */
+static int mpu_iio_buffer_preenable(struct iio_dev *indio_dev)
+{
+    return mpu_pm_get(mpu_iio_priv(indio_dev));
+}
+
+static int mpu_iio_buffer_postdisable(struct iio_dev *indio_dev)
+{
+    mpu_pm_put(mpu_iio_priv(indio_dev));
+    return 0;
+}
+
+static const struct iio_buffer_setup_ops mpu_iio_buffer_ops = {
+    .preenable = mpu_iio_buffer_preenable,
+    .postdisable = mpu_iio_buffer_postdisable,
+};
+
+/* called from mpu_publish() with md->lock held */
+static void mpu_iio_push(struct mpu_dev *md, const struct mpu_sample *s)
+{
+    if (!READ_ONCE(md->iio.trig_on))
+        return;
+    md->iio.cur = s;
+    iio_trigger_poll_nested(md->iio.trig);
+    md->iio.cur = NULL;
+}
+
+static int mpu_iio_setup(struct mpu_dev *md)
+{
+    struct i2c_client *client = md->client;
+    struct iio_dev *indio_dev;
+    int ret, i;
+
+    for (i = 0; i < 4; i++) {
+        mpu_iio_accel_avail[2 * i + 1] = mpu_accel_scale_nano[i];
+        mpu_iio_gyro_avail[2 * i + 1] = mpu_gyro_scale_nano[i];
+    }
+
+    indio_dev = devm_iio_device_alloc(&client->dev, sizeof(md));
+    if (!indio_dev)
+        return -ENOMEM;
+    *(struct mpu_dev **)iio_priv(indio_dev) = md;
+    indio_dev->name = DEVICE_NAME;
+    indio_dev->info = &mpu_iio_info;
+    indio_dev->modes = INDIO_DIRECT_MODE;
+    indio_dev->channels = mpu_iio_channels;
+    indio_dev->num_channels = ARRAY_SIZE(mpu_iio_channels);
+
+    ret = devm_iio_triggered_buffer_setup(&client->dev, indio_dev, iio_pollfunc_store_time,
+                                          mpu_iio_trigger_handler, &mpu_iio_buffer_ops);
+    if (ret)
+        return ret;
+
+    md->iio.trig = devm_iio_trigger_alloc(&client->dev, "%s-dev%d", indio_dev->name,
+                                          iio_device_id(indio_dev));
+    if (!md->iio.trig)
+        return -ENOMEM;
+    md->iio.trig->ops = &mpu_iio_trigger_ops;
+    iio_trigger_set_drvdata(md->iio.trig, indio_dev);
+    ret = devm_iio_trigger_register(&client->dev, md->iio.trig);
+    if (ret)
+        return ret;
+    indio_dev->trig = iio_trigger_get(md->iio.trig);
+
+    /* not devm: must be gone before remove() tears down acquisition */
+    ret = iio_device_register(indio_dev);
+    if (ret)
+        return ret;
+    md->iio.indio_dev = indio_dev;
+    return 0;
+}
+
+static void mpu_iio_teardown(struct mpu_dev *md)
+{
+    if (md->iio.indio_dev)
+        iio_device_unregister(md->iio.indio_dev);
+    md->iio.indio_dev = NULL;
+}
+#else
+static void mpu_iio_push(struct mpu_dev *md, const struct mpu_sample *s) { }
+static int mpu_iio_setup(struct mpu_dev *md) { return 0; }
+static void mpu_iio_teardown(struct mpu_dev *md) { }
+#endif
+
+/* ---------- input device ---------- */
+/*
+ * With input_poll_ms=N the sensor is also an input device (ABS_X/Y/Z
+ * accel, ABS_RX/RY/RZ gyro, INPUT_PROP_ACCELEROMETER): every published
+ * sample becomes one SYN_REPORT frame stamped with its acquisition time,
+ * and while no streaming mode runs the input poller takes a burst every
+ * N ms (adjustable in the input device's poll attribute).
+ */
+#if IS_ENABLED(CONFIG_INPUT)
+/* resolution is LSB per g and per deg/s, so it follows the ranges */
+static void mpu_input_set_res(struct mpu_dev *md, u8 accel_fs, u8 gyro_fs)
+{
+    struct input_dev *in = md->input.dev;
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        input_abs_set_res(in, ABS_X + i, ACCEL_SENS_2G >> accel_fs);
+        input_abs_set_res(in, ABS_RX + i, GYRO_SENS_250 >> gyro_fs);
+    }
+    md->input.accel_fs = accel_fs;
+    md->input.gyro_fs = gyro_fs;
+}
+
+/* one frame per sample; called from mpu_publish() with md->lock held */
+static void mpu_input_push(struct mpu_dev *md, const struct mpu_sample *s)
+{
+    struct input_dev *in = md->input.dev;
+    int i;
+
+    if (!READ_ONCE(md->input.open))
+        return;
+    if (s->hdr.accel_fs != md->input.accel_fs || s->hdr.gyro_fs != md->input.gyro_fs)
+        mpu_input_set_res(md, s->hdr.accel_fs, s->hdr.gyro_fs);
+    input_set_timestamp(in, ns_to_ktime(s->hdr.timestamp_ns));
+    for (i = 0; i < 3; i++) {
+        input_report_abs(in, ABS_X + i, s->accel[i]);
+        input_report_abs(in, ABS_RX + i, s->gyro[i]);
+    }
+    input_sync(in);
+}
+
+/* streaming modes report every sample already; otherwise sample like a read() */
+static void mpu_input_poll(struct input_dev *in)
+{
+    struct mpu_dev *md = input_get_drvdata(in);
+    struct mpu_sample s;
+
+    if (READ_ONCE(md->mode) != MPU_MODE_ONDEMAND)
+        return;
+    mpu_warmup_wait(md);
+    mpu_bus_lock(md);
+    if (!md->dead) {
+        if (!mpu_burst_read(md, &s))
+            mpu_publish(md, &s);
+        else
+            WRITE_ONCE(md->ring.hdr->errors, md->ring.hdr->errors + 1);
+    }
+    mutex_unlock(&md->lock);
+}
+
+/* an evdev client counts as a user, like an open /dev/mpu6050-N */
+static int mpu_input_open(struct input_dev *in)
+{
+    struct mpu_dev *md = input_get_drvdata(in);
+    int ret;
+
+    ret = mpu_acq_get(md);
+    if (ret)
+        return ret;
+    WRITE_ONCE(md->input.open, true);
+    return 0;
+}
+
+static void mpu_input_close(struct input_dev *in)
+{
+    struct mpu_dev *md = input_get_drvdata(in);
+
+    WRITE_ONCE(md->input.open, false);
+    mpu_acq_put(md);
+}
+
+static int mpu_input_setup(struct mpu_dev *md)
+{
+    struct input_dev *in;
+    int ret, i;
+
+    if (!input_poll_ms)
+        return 0;
+    /* not devm: must be gone before remove() tears down acquisition */
+    in = input_allocate_device();
+    if (!in)
+        return -ENOMEM;
+    in->name = "MPU6050 accelerometer/gyroscope";
+    in->phys = dev_name(&md->client->dev);
+    in->id.bustype = BUS_I2C;
+    in->dev.parent = &md->client->dev;
+    in->open = mpu_input_open;
+    in->close = mpu_input_close;
+    input_set_drvdata(in, md);
+    __set_bit(INPUT_PROP_ACCELEROMETER, in->propbit);
+    for (i = 0; i < 3; i++) {
+        input_set_abs_params(in, ABS_X + i, S16_MIN, S16_MAX, 0, 0);
+        input_set_abs_params(in, ABS_RX + i, S16_MIN, S16_MAX, 0, 0);
+    }
+    md->input.dev = in;
+    mpu_input_set_res(md, md->cfg.accel_fs, md->cfg.gyro_fs);
+
+    ret = input_setup_polling(in, mpu_input_poll);
+    if (!ret) {
+        input_set_poll_interval(in, input_poll_ms);
+        input_set_min_poll_interval(in, 1);
+        input_set_max_poll_interval(in, 1000);
+        ret = input_register_device(in);
+    }
+    if (ret) {
+        input_free_device(in);
+        md->input.dev = NULL;
+    }
+    return ret;
+}
+
+static void mpu_input_teardown(struct mpu_dev *md)
+{
+    if (md->input.dev)
+        input_unregister_device(md->input.dev);
+    md->input.dev = NULL;
+}
+#else
+static void mpu_input_push(struct mpu_dev *md, const struct mpu_sample *s) { }
+static int mpu_input_setup(struct mpu_dev *md) { return 0; }
+static void mpu_input_teardown(struct mpu_dev *md) { }
+#endif
+
+/* ---------- flight recorder ---------- */
+/*
+ * MPU_IOC_SET_CAPTURE: published records run through a circular buffer of
+ * pre + post slots until |a| crosses threshold_mg (or
+ * MPU_IOC_CAPTURE_TRIGGER), post more records are taken and the buffer
+ * freezes. sysfs "capture" returns it as one blob and is notified for
+ * poll() when it freezes; no reader has to stay open.
+ */
+/* |a| against threshold_mg at the record's own range, compared squared */
+static bool mpu_capture_hit(const struct mpu_capture *c, const struct mpu_sample *s)
+{
+    s64 thr, a2;
+
+    if (!c->cfg.threshold_mg)
+        return false;
+    thr = (s64)c->cfg.threshold_mg * (ACCEL_SENS_2G >> s->hdr.accel_fs) / 1000;
+    a2 = (s64)s->accel[0] * s->accel[0] + (s64)s->accel[1] * s->accel[1] +
+         (s64)s->accel[2] * s->accel[2];
+    if (c->cfg.flags & MPU_CAPTURE_F_BELOW)
+        return a2 < thr * thr;
+    return a2 >= thr * thr;
+}
+
+/* the next record stored is the trigger record. Caller holds md->lock. */
+static void mpu_capture_fire(struct mpu_capture *c, u16 source, u64 ts)
+{
+    c->state = MPU_CAPTURE_TRIGGERED;
+    c->source = source;
+    c->trigger = c->pos;
+    c->trigger_ns = ts;
+    c->left = c->cfg.post;
+}
+
+/* every published record; caller holds md->lock */
+static void mpu_capture_push(struct mpu_dev *md, const struct mpu_sample *s)
+{
+    struct mpu_capture *c = &md->capture;
+
+    if (c->state == MPU_CAPTURE_ARMED && mpu_capture_hit(c, s))
+        mpu_capture_fire(c, MPU_CAPTURE_SRC_THRESHOLD, s->hdr.timestamp_ns);
+    if (c->state != MPU_CAPTURE_ARMED && c->state != MPU_CAPTURE_TRIGGERED)
+        return;
+    c->buf[c->pos] = *s;
+    c->pos = c->pos + 1 == c->len ? 0 : c->pos + 1;
+    if (c->filled < c->len)
+        c->filled++;
+    if (c->state == MPU_CAPTURE_TRIGGERED && !--c->left) {
+        c->state = MPU_CAPTURE_DONE;
+        schedule_work(&c->work);
+    }
+}
+
+/* frozen: stop keeping the sensor busy and tell sysfs pollers */
+static void mpu_capture_work(struct work_struct *work)
+{
+    struct mpu_dev *md = container_of(work, struct mpu_dev, capture.work);
+    struct mpu_capture *c = &md->capture;
+
+    mutex_lock(&c->lock);
+    /* DONE only leaves through SET, which needs c->lock */
+    if (c->held && READ_ONCE(c->state) == MPU_CAPTURE_DONE) {
+        mpu_acq_put(md);
+        c->held = false;
+    }
+    mutex_unlock(&c->lock);
+    sysfs_notify(&md->client->dev.kobj, NULL, "capture");
+}
+
+/* (re)arm with a fresh buffer, or disarm with pre == post == 0 */
+static int mpu_set_capture(struct mpu_dev *md, const struct mpu_capture_cfg *cfg)
+{
+    struct mpu_capture *c = &md->capture;
+    struct mpu_sample *buf = NULL, *old;
+    u32 len;
+    int ret = 0;
+
+    if (cfg->pre > MPU_CAPTURE_MAX || cfg->post > MPU_CAPTURE_MAX ||
+        (cfg->flags & ~MPU_CAPTURE_F_BELOW))
+        return -EINVAL;
+    len = cfg->pre + cfg->post;
+    if (len > MPU_CAPTURE_MAX || (len && !cfg->post))
+        return -EINVAL;
+    if (len) {
+        buf = vmalloc_array(len, sizeof(*buf));
+        if (!buf)
+            return -ENOMEM;
+    }
+
+    mutex_lock(&c->lock);
+    if (c->closed) {
+        ret = -ENODEV;
+        goto out;
+    }
+    /* records only flow while something acquires; be that something */
+    if (len && !c->held) {
+        ret = mpu_acq_get(md);
+        if (ret)
+            goto out;
+        if (READ_ONCE(md->mode) == MPU_MODE_ONDEMAND)
+            ret = mpu_set_mode(md, mpu_stream_mode(md));
+        if (ret) {
+            mpu_acq_put(md);
+            goto out;
+        }
+        c->held = true;
+    }
+
+    mutex_lock(&md->lock);
+    old = c->buf;
+    c->buf = buf;
+    buf = old;
+    c->cfg = *cfg;
+    c->len = len;
+    c->pos = 0;
+    c->filled = 0;
+    c->left = 0;
+    c->state = len ? MPU_CAPTURE_ARMED : MPU_CAPTURE_IDLE;
+    c->id++;
+    mutex_unlock(&md->lock);
+
+    if (!len && c->held) {
+        mpu_acq_put(md);
+        c->held = false;
+    }
+out:
+    mutex_unlock(&c->lock);
+    vfree(buf);
+    return ret;
+}
+
+static void mpu_get_capture(struct mpu_dev *md, struct mpu_capture_cfg *out)
+{
+    mutex_lock(&md->capture.lock);
+    *out = md->capture.cfg;
+    mutex_unlock(&md->capture.lock);
+}
+
+static int mpu_capture_trigger(struct mpu_dev *md)
+{
+    struct mpu_capture *c = &md->capture;
+    int ret = 0;
+
+    mutex_lock(&md->lock);
+    if (c->state == MPU_CAPTURE_ARMED)
+        mpu_capture_fire(c, MPU_CAPTURE_SRC_IOCTL, ktime_get_ns());
+    else
+        ret = c->state == MPU_CAPTURE_IDLE ? -EINVAL : -EBUSY;
+    mutex_unlock(&md->lock);
+    return ret;
+}
+
+/* unbind: disarm for good before acquisition is torn down */
+static void mpu_capture_teardown(struct mpu_dev *md)
+{
+    struct mpu_capture *c = &md->capture;
+
+    mutex_lock(&c->lock);
+    c->closed = true;
+    mutex_lock(&md->lock);
+    if (c->state != MPU_CAPTURE_DONE)
+        c->state = MPU_CAPTURE_IDLE;
+    mutex_unlock(&md->lock);
+    if (c->held) {
+        mpu_acq_put(md);
+        c->held = false;
+    }
+    mutex_unlock(&c->lock);
+    cancel_work_sync(&c->work);
+}
+
+/*
+ * sysfs capture: struct mpu_capture_hdr, then once frozen nr records oldest
+ * first. A reader that spans several read() calls compares hdr.id.
+ */
+static ssize_t capture_read(struct file *filp, struct kobject *kobj, struct bin_attribute *attr,
+                            char *buf, loff_t off, size_t count)
+{
+    struct mpu_dev *md = dev_get_drvdata(kobj_to_dev(kobj));
+    struct mpu_capture *c = &md->capture;
+    struct mpu_capture_hdr h = { 0 };
+    size_t total, done = 0, n;
+    u32 first = 0, i, rem;
+
+    mutex_lock(&md->lock);
+    h.version = MPU_CAPTURE_VERSION;
+    h.state = c->state;
+    h.id = c->id;
+    h.record_size = sizeof(struct mpu_sample);
+    if (c->state == MPU_CAPTURE_DONE) {
+        /* a full ring starts at the slot written next */
+        if (c->filled == c->len)
+            first = c->pos;
+        h.nr = c->filled;
+        h.trigger = (c->trigger + c->len - first) % c->len;
+        h.trigger_ns = c->trigger_ns;
+        h.source = c->source;
+    }
+    total = sizeof(h) + (size_t)h.nr * sizeof(struct mpu_sample);
+    if (off >= total) {
+        mutex_unlock(&md->lock);
+        return 0;
+    }
+    count = min_t(size_t, count, total - off);
+    while (done < count) {
+        if (off < sizeof(h)) {
+            n = min_t(size_t, count - done, sizeof(h) - off);
+            memcpy(buf + done, (u8 *)&h + off, n);
+        } else {
+            i = div_u64_rem(off - sizeof(h), sizeof(struct mpu_sample), &rem);
+            n = min_t(size_t, count - done, sizeof(struct mpu_sample) - rem);
+            memcpy(buf + done, (u8 *)&c->buf[(first + i) % c->len] + rem, n);
+        }
+        done += n;
+        off += n;
+    }
+    mutex_unlock(&md->lock);
+    return done;
+}
+static BIN_ATTR_RO(capture, 0);
+
+/* ---------- sysfs show functions (reuse code from you) ---------- */
+/* served from the last published sample; the bus only once it is older than snapshot_max_age_ms */
+static inline long labs_long(long v) { return v < 0 ? -v : v; }
+
+static bool mpu_snapshot_fresh(struct mpu_dev *md, const struct mpu_sample *s)
+{
+    u64 max_age = (u64)READ_ONCE(md->snap.max_age_ms) * NSEC_PER_MSEC;
+
+    return s->hdr.version && ktime_get_ns() - s->hdr.timestamp_ns <= max_age;
+}
+
+/*
+ * Coherent copy of the newest sample. A fresh one costs no bus access and
+ * no lock; a stale one is refreshed by one burst that serves every
+ * attribute read after it.
+ */
+static int mpu_snapshot_get(struct mpu_dev *md, struct mpu_sample *out)
+{
+    struct mpu_sample s;
+    unsigned int seq;
+    int ret = 0;
+
+    do {
+        seq = read_seqcount_begin(&md->snap.seq);
+        *out = md->snap.s;
+    } while (read_seqcount_retry(&md->snap.seq, seq));
+    if (mpu_snapshot_fresh(md, out))
+        return 0;
+    /* a running stream keeps it current; a raw burst would bypass the filter */
+    if (out->hdr.version && READ_ONCE(md->mode) != MPU_MODE_ONDEMAND)
+        return 0;
+
+    /* a sleeping sensor is woken just for this and autosuspends again */
+    ret = mpu_pm_get(md);
+    if (ret)
+        return ret;
+    mpu_warmup_wait(md);
+    mpu_bus_lock(md);
+    if (!mpu_snapshot_fresh(md, &md->snap.s)) {
+        ret = mpu_burst_read(md, &s);
+        if (!ret)
+            mpu_publish(md, &s);
+    }
+    *out = md->snap.s;
+    mutex_unlock(&md->lock);
+    mpu_pm_put(md);
+    return ret;
+}
+
+static int mpu_fmt_accel(char *buf, s16 raw, u8 fs)
+{
+    long ms2_x1000 = (long)raw * 9807 / (ACCEL_SENS_2G >> fs);
+    return sprintf(buf, "%d\t%ld.%03ld\n", (int)raw, ms2_x1000 / 1000, labs_long(ms2_x1000 % 1000));
+}
+static int mpu_fmt_temp(char *buf, s16 raw)
+{
+    long tmp_x100 = ((long)raw * 100 / 340) + 3653;
+    return sprintf(buf, "%d\t%ld.%02ld\n", (int)raw, tmp_x100/100, labs_long(tmp_x100%100));
+}
+static int mpu_fmt_gyro(char *buf, s16 raw, u8 fs)
+{
+    long dps_x100 = (long)raw * 1000 / mpu_gyro_sens_x10[fs];
+    return sprintf(buf, "%d\t%ld.%02ld\n", (int)raw, dps_x100/100, labs_long(dps_x100%100));
+}
+
+#define MPU_ACCEL_SHOW(_name, _i)                                                   \
+static ssize_t _name##_show(struct device *dev, struct device_attribute *attr, char *buf) \
+{                                                                                   \
+    struct mpu_dev *md = dev_get_drvdata(dev);                                      \
+    struct mpu_sample s;                                                            \
+    if (mpu_snapshot_get(md, &s))                                                   \
+        return -EIO;                                                                \
+    return mpu_fmt_accel(buf, s.accel[_i], s.hdr.accel_fs);                         \
+}
+#define MPU_GYRO_SHOW(_name, _i)                                                    \
+static ssize_t _name##_show(struct device *dev, struct device_attribute *attr, char *buf) \
+{                                                                                   \
+    struct mpu_dev *md = dev_get_drvdata(dev);                                      \
+    struct mpu_sample s;                                                            \
+    if (mpu_snapshot_get(md, &s))                                                   \
+        return -EIO;                                                                \
+    return mpu_fmt_gyro(buf, s.gyro[_i], s.hdr.gyro_fs);                            \
+}
+
+MPU_ACCEL_SHOW(accel_x, 0)
+MPU_ACCEL_SHOW(accel_y, 1)
+MPU_ACCEL_SHOW(accel_z, 2)
+MPU_GYRO_SHOW(gyro_x, 0)
+MPU_GYRO_SHOW(gyro_y, 1)
+MPU_GYRO_SHOW(gyro_z, 2)
+
+static ssize_t temp_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct mpu_dev *md = dev_get_drvdata(dev);
+    struct mpu_sample s;
+    s16 raw;
+    if (mpu_chan_temp_cached(md, &raw))
+        return mpu_fmt_temp(buf, raw);
+    if (mpu_snapshot_get(md, &s))
+        return -EIO;
+    return mpu_fmt_temp(buf, s.temp);
+}
+
+/* every channel from the same instant: "<name>\t<raw>\t<value>" per line */
+static ssize_t all_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    static const char * const axis[] = { "x", "y", "z" };
+    struct mpu_dev *md = dev_get_drvdata(dev);
+    struct mpu_sample s;
+    int i, len = 0;
+
+    if (mpu_snapshot_get(md, &s))
+        return -EIO;
+    for (i = 0; i < 3; i++) {
+        len += sprintf(buf + len, "accel_%s\t", axis[i]);
+        len += mpu_fmt_accel(buf + len, s.accel[i], s.hdr.accel_fs);
+    }
+    len += sprintf(buf + len, "temp\t");
+    len += mpu_fmt_temp(buf + len, s.temp);
+    for (i = 0; i < 3; i++) {
+        len += sprintf(buf + len, "gyro_%s\t", axis[i]);
+        len += mpu_fmt_gyro(buf + len, s.gyro[i], s.hdr.gyro_fs);
+    }
+    return len;
+}
+
+static ssize_t snapshot_max_age_ms_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct mpu_dev *md = dev_get_drvdata(dev);
+
+    return sprintf(buf, "%u\n", READ_ONCE(md->snap.max_age_ms));
+}
+static ssize_t snapshot_max_age_ms_store(struct device *dev, struct device_attribute *attr,
+                                         const char *buf, size_t count)
+{
+    struct mpu_dev *md = dev_get_drvdata(dev);
+    unsigned int val;
+
+    if (kstrtouint(buf, 0, &val))
+        return -EINVAL;
+    WRITE_ONCE(md->snap.max_age_ms, val);
+    return count;
+}
+
+/* device attrs */
+static DEVICE_ATTR_RO(accel_x);
+static DEVICE_ATTR_RO(accel_y);
+static DEVICE_ATTR_RO(accel_z);
+static DEVICE_ATTR_RO(temp);
+static DEVICE_ATTR_RO(gyro_x);
+static DEVICE_ATTR_RO(gyro_y);
+static DEVICE_ATTR_RO(gyro_z);
+static DEVICE_ATTR_RO(all);
+static DEVICE_ATTR_RW(snapshot_max_age_ms);
+
+/* ---------- sysfs configuration ---------- */
+static ssize_t sample_rate_hz_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct mpu_dev *md = dev_get_drvdata(dev);
+
+    return sprintf(buf, "%u\n", READ_ONCE(md->odr_hz));
+}
+static ssize_t sample_rate_hz_store(struct device *dev, struct device_attribute *attr,
+                                    const char *buf, size_t count)
+{
+    struct mpu_dev *md = dev_get_drvdata(dev);
+    struct mpu_config c;
+    u16 val;
+    int ret;
+
+    if (kstrtou16(buf, 0, &val) || !val)
+        return -EINVAL;
+    mpu_get_config(md, &c);
+    c.odr_hz = val;
+    ret = mpu_set_config(md, &c);
+    return ret ? ret : count;
+}
+static ssize_t dlpf_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct mpu_dev *md = dev_get_drvdata(dev);
+
+    return sprintf(buf, "%u\n", READ_ONCE(md->cfg.dlpf));
+}
+static ssize_t dlpf_store(struct device *dev, struct device_attribute *attr,
+                          const char *buf, size_t count)
+{
+    struct mpu_dev *md = dev_get_drvdata(dev);
+    struct mpu_config c;
+    u8 val;
+    int ret;
+
+    if (kstrtou8(buf, 0, &val))
+        return -EINVAL;
+    mpu_get_config(md, &c);
+    c.dlpf = val;
+    ret = mpu_set_config(md, &c);
+    return ret ? ret : count;
+}
+static ssize_t accel_range_g_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct mpu_dev *md = dev_get_drvdata(dev);
+
+    return sprintf(buf, "%d\n", 2 << READ_ONCE(md->cfg.accel_fs));
+}
+static ssize_t accel_range_g_store(struct device *dev, struct device_attribute *attr,
+                                   const char *buf, size_t count)
+{
+    struct mpu_dev *md = dev_get_drvdata(dev);
+    struct mpu_config c;
+    unsigned int val;
+    int ret, fs;
+
+    if (kstrtouint(buf, 0, &val) || val < 2 || val > 16 || !is_power_of_2(val))
+        return -EINVAL;
+    fs = ilog2(val) - 1;
+    mpu_get_config(md, &c);
+    c.accel_fs = fs;
+    ret = mpu_set_config(md, &c);
+    return ret ? ret : count;
+}
+static ssize_t gyro_range_dps_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct mpu_dev *md = dev_get_drvdata(dev);
+
+    return sprintf(buf, "%d\n", mpu_gyro_range_dps[READ_ONCE(md->cfg.gyro_fs)]);
+}
+static ssize_t gyro_range_dps_store(struct device *dev, struct device_attribute *attr,
+                                    const char *buf, size_t count)
+{
+    struct mpu_dev *md = dev_get_drvdata(dev);
+    struct mpu_config c;
+    unsigned int val;
+    int ret, fs;
+
+    if (kstrtouint(buf, 0, &val))
+        return -EINVAL;
+    for (fs = 0; fs < ARRAY_SIZE(mpu_gyro_range_dps); fs++)
+        if (mpu_gyro_range_dps[fs] == val)
+            break;
+    if (fs == ARRAY_SIZE(mpu_gyro_range_dps))
+        return -EINVAL;
+    mpu_get_config(md, &c);
+    c.gyro_fs = fs;
+    ret = mpu_set_config(md, &c);
+    return ret ? ret : count;
+}
+
+static DEVICE_ATTR_RW(sample_rate_hz);
+static DEVICE_ATTR_RW(dlpf);
+static DEVICE_ATTR_RW(accel_range_g);
+static DEVICE_ATTR_RW(gyro_range_dps);
+
+/* ---------- sysfs power ---------- */
+static ssize_t warmup_ms_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct mpu_dev *md = dev_get_drvdata(dev);
+
+    return sprintf(buf, "%u\n", READ_ONCE(md->pm.warmup_ms));
+}
+static ssize_t warmup_ms_store(struct device *dev, struct device_attribute *attr,
+                               const char *buf, size_t count)
+{
+    struct mpu_dev *md = dev_get_drvdata(dev);
+    unsigned int val;
+
+    if (kstrtouint(buf, 0, &val) || val > 1000)
+        return -EINVAL;
+    WRITE_ONCE(md->pm.warmup_ms, val);
+    return count;
+}
+/* last wake to first sample; debugfs stats has the full histogram */
+static ssize_t wake_latency_us_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct mpu_dev *md = dev_get_drvdata(dev);
+
+    return sprintf(buf, "%u\n", READ_ONCE(md->pm.last_wake_us));
+}
+
+/* probe to end of the deferred bring-up, 0 until then */
+static ssize_t probe_ready_us_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct mpu_dev *md = dev_get_drvdata(dev);
+
+    return sprintf(buf, "%u\n", READ_ONCE(md->boot.ready_us));
+}
+
+static DEVICE_ATTR_RW(warmup_ms);
+static DEVICE_ATTR_RO(wake_latency_us);
+static DEVICE_ATTR_RO(probe_ready_us);
+
+/* ---------- sysfs timer pacing ---------- */
+static ssize_t timer_rate_hz_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct mpu_dev *md = dev_get_drvdata(dev);
+
+    return sprintf(buf, "%u\n", READ_ONCE(md->timer.rate_hz));
+}
+/* 0 follows the sensor ODR; a running timer picks it up on its next tick */
+static ssize_t timer_rate_hz_store(struct device *dev, struct device_attribute *attr,
+                                   const char *buf, size_t count)
+{
+    struct mpu_dev *md = dev_get_drvdata(dev);
+    unsigned int val;
+
+    if (kstrtouint(buf, 0, &val) || val > MPU_TIMER_MAX_HZ)
+        return -EINVAL;
+    WRITE_ONCE(md->timer.rate_hz, val);
+    return count;
+}
+
+static DEVICE_ATTR_RW(timer_rate_hz);
+
+/* learned FIFO frame period against nominal; 0 until FIFO mode has run */
+static ssize_t sample_clock_ppm_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct mpu_dev *md = dev_get_drvdata(dev);
+    s64 nominal, ppm = 0;
+
+    mutex_lock(&md->lock);
+    if (md->stream.ts_valid) {
+        nominal = mpu_nominal_period_q16(md);
+        ppm = div64_s64(((s64)md->stream.period_q16 - nominal) * 1000000, nominal);
+    }
+    mutex_unlock(&md->lock);
+    return sprintf(buf, "%lld\n", ppm);
+}
+
+static DEVICE_ATTR_RO(sample_clock_ppm);
+
+/* RMS of high-passed acceleration over the last adaptive window */
+static ssize_t activity_mg_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct mpu_dev *md = dev_get_drvdata(dev);
+
+    return sprintf(buf, "%u\n", READ_ONCE(md->adapt.rms_mg));
+}
+
+static DEVICE_ATTR_RO(activity_mg);
+
+/* ---------- char device operations ---------- */
+/*
+ * read() returns the legacy packed layout (6 or 14 bytes of little-endian
+ * int16), a versioned struct mpu_sample or, with MPU_FMT_SI, the same
+ * record scaled to int32 ug, mdeg/s and mdegC, selected per open file with
+ * MPU_IOC_SET_FMT. Timestamps are taken at acquisition and shifted to the
+ * file's MPU_IOC_SET_CLOCK clock on the way out.
+ */
+/* legacy layout: ax,ay,az,temp,gx,gy,gz as little-endian int16 */
+static size_t mpu_pack_legacy(const struct mpu_sample *s, __le16 *out)
+{
+    out[0] = cpu_to_le16(s->accel[0]);
+    out[1] = cpu_to_le16(s->accel[1]);
+    out[2] = cpu_to_le16(s->accel[2]);
+    out[3] = cpu_to_le16(s->temp);
+    out[4] = cpu_to_le16(s->gyro[0]);
+    out[5] = cpu_to_le16(s->gyro[1]);
+    out[6] = cpu_to_le16(s->gyro[2]);
+    return 7 * sizeof(__le16);
+}
+
+/* scaled with the sample's own ranges, integer only */
+static void mpu_pack_si(const struct mpu_sample *s, struct mpu_sample_si *out)
+{
+    int i;
+
+    out->hdr = s->hdr;
+    out->hdr.size = sizeof(*out);
+    for (i = 0; i < 3; i++) {
+        /* 10^6 / 16384 ug per LSB at +-2 g is 15625 / 256 */
+        out->accel[i] = ((s64)s->accel[i] * (15625 << s->hdr.accel_fs)) / 256;
+        out->gyro[i] = s->gyro[i] * 10000 / mpu_gyro_sens_x10[s->hdr.gyro_fs];
+    }
+    out->temp = s->temp * 1000 / 340 + 36530;
+    out->reserved = 0;
+}
+
+/* what one sample becomes on the way out of read() */
+union mpu_out {
+    __le16 legacy[7];
+    struct mpu_sample_si si;
+};
+
+/* bytes per record in format fmt for a read() of count bytes */
+static size_t mpu_rec_len(u32 fmt, size_t count)
+{
+    switch (fmt) {
+    case MPU_FMT_RECORD:
+        return sizeof(struct mpu_sample);
+    case MPU_FMT_SI:
+        return sizeof(struct mpu_sample_si);
+    default:
+        /* old readers ask for 6 bytes (accel only), newer ones for 14 */
+        return count >= 7 * sizeof(__le16) ? 7 * sizeof(__le16) : 6;
+    }
+}
+
+static const void *mpu_pack(u32 fmt, const struct mpu_sample *s, union mpu_out *o)
+{
+    switch (fmt) {
+    case MPU_FMT_RECORD:
+        return s;
+    case MPU_FMT_SI:
+        mpu_pack_si(s, &o->si);
+        return &o->si;
+    default:
+        mpu_pack_legacy(s, o->legacy);
+        return o->legacy;
+    }
+}
+
+/*
+ * Offset from CLOCK_MONOTONIC to the file's clock, taken once per read().
+ * Records are seconds old at most, so NTP slew in between is negligible.
+ */
+static s64 mpu_clock_offset(u32 clock)
+{
+    switch (clock) {
+    case CLOCK_MONOTONIC_RAW:
+        return ktime_get_raw_ns() - ktime_get_ns();
+    case CLOCK_BOOTTIME:
+        return ktime_get_boottime_ns() - ktime_get_ns();
+    }
+    return 0;
+}
+
+/* copy one sample out in the file's format */
+static ssize_t mpu_copy_sample(struct mpu_file *mf, const struct mpu_sample *s,
+                               struct iov_iter *to)
+{
+    u32 fmt = READ_ONCE(mf->fmt);
+    size_t len = mpu_rec_len(fmt, iov_iter_count(to));
+    union mpu_out o;
+
+    if (copy_to_iter(mpu_pack(fmt, s, &o), len, to) != len)
+        return -EFAULT;
+    return len;
+}
+
+/* ---------- per-file ring cursors ---------- */
+/*
+ * read() in a streaming mode serves each open file from its own cursor
+ * into the ring, so any number of readers share one acquisition stream;
+ * each gets every decim-th sample (MPU_IOC_SET_DECIM) and its own overrun
+ * count. poll() reports readable once the file has watermark records (one
+ * in DRDY mode).
+ */
+/* samples published since this file's cursor; nr_slots or more means it was lapped */
+static u32 mpu_file_pending(struct mpu_file *mf)
+{
+    struct mpu_dev *md = mf->md;
+    u32 start = READ_ONCE(md->mode_start);
+    u32 from = READ_ONCE(mf->cursor);
+
+    if ((s32)(from - start) < 0)
+        from = start;
+    return smp_load_acquire(&md->ring.hdr->head) - from;
+}
+
+/* whole records this file could read now, after decimation */
+static u32 mpu_file_avail(struct mpu_file *mf)
+{
+    u32 pending = min(mpu_file_pending(mf), mf->md->ring.mask + 1);
+    u32 skip = READ_ONCE(mf->skip);
+
+    if (pending <= skip)
+        return 0;
+    return 1 + (pending - skip - 1) / READ_ONCE(mf->decim);
+}
+
+/* readable: want records queued, or lapped so read() must report the overrun */
+static bool mpu_file_ready(struct mpu_file *mf, u32 want)
+{
+    return mpu_file_avail(mf) >= want || mpu_file_pending(mf) > mf->md->ring.mask;
+}
+
+/*
+ * Next sample for this file, with the lock-free ring protocol from
+ * mpu6050_uapi.h. A lapped reader skips to the oldest slot that is safe
+ * to copy and counts what it lost. Returns false once caught up.
+ * Caller holds mf->read_lock.
+ */
+static bool mpu_file_next(struct mpu_file *mf, struct mpu_sample *s)
+{
+    struct mpu_ring *ring = &mf->md->ring;
+    u32 start = READ_ONCE(mf->md->mode_start);
+    u32 nr = ring->mask + 1;
+    u32 head, lost;
+
+    if ((s32)(mf->cursor - start) < 0) {
+        WRITE_ONCE(mf->cursor, start);
+        WRITE_ONCE(mf->skip, 0);
+    }
+    for (;;) {
+        head = smp_load_acquire(&ring->hdr->head);
+        if (head - mf->cursor >= nr) {
+            lost = head - mf->cursor - nr + 1;
+            WRITE_ONCE(mf->overruns, mf->overruns + lost);
+            WRITE_ONCE(mf->cursor, mf->cursor + lost);
+            WRITE_ONCE(mf->skip, 0);
+            mf->gap = true;
+        }
+        if (mf->cursor == head)
+            return false;
+
+        *s = ring->slots[mf->cursor & ring->mask];
+        smp_rmb();
+        if (READ_ONCE(ring->hdr->head) - mf->cursor >= nr)
+            continue;       /* rewritten while we copied it */
+        WRITE_ONCE(mf->cursor, mf->cursor + 1);
+
+        if (mf->skip) {
+            WRITE_ONCE(mf->skip, mf->skip - 1);
+            continue;
+        }
+        WRITE_ONCE(mf->skip, mf->decim - 1);
+        if (mf->gap)
+            s->hdr.flags |= MPU_REC_F_GAP;
+        mf->gap = false;
+        return true;
+    }
+}
+
+/*
+ * Streamed modes: hand out this file's unread samples as whole records, as
+ * many as fit. Blocks until the watermark (FIFO, TIMER) or one record
+ * (DRDY) is queued for this file; nothing here touches the bus. The
+ * iterator is a user buffer for read() and pipe pages for splice().
+ */
+static ssize_t mpu_ring_read(struct kiocb *iocb, struct iov_iter *to, u32 mode)
+{
+    struct file *filp = iocb->ki_filp;
+    struct mpu_file *mf = filp->private_data;
+    struct mpu_dev *md = mf->md;
+    u32 fmt = READ_ONCE(mf->fmt);
+    size_t count = iov_iter_count(to);
+    size_t rec = mpu_rec_len(fmt, count), done = 0;
+    struct mpu_sample s;
+    union mpu_out o;
+    u32 want = 1;
+    int ret = 0;
+    s64 off;
+
+    if (mode == MPU_MODE_FIFO || mode == MPU_MODE_TIMER)
+        want = clamp_t(size_t, count / rec, 1, READ_ONCE(md->stream.watermark));
+
+    if (!mpu_file_ready(mf, want)) {
+        if ((filp->f_flags & O_NONBLOCK) || (iocb->ki_flags & IOCB_NOWAIT))
+            return -EAGAIN;
+        ret = wait_event_interruptible(md->wq,
+                                       mpu_file_ready(mf, want) ||
+                                       READ_ONCE(md->mode) != mode ||
+                                       READ_ONCE(md->dead));
+        if (ret)
+            return ret;
+        trace_mpu6050_reader_wake(md->minor, READ_ONCE(mf->cursor), mpu_file_avail(mf));
+    }
+
+    if (mutex_lock_interruptible(&mf->read_lock))
+        return -ERESTARTSYS;
+    off = mpu_clock_offset(mf->clock);
+    while (done + rec <= count && mpu_file_next(mf, &s)) {
+        s.hdr.timestamp_ns += off;
+        if (copy_to_iter(mpu_pack(fmt, &s, &o), rec, to) != rec) {
+            ret = -EFAULT;
+            break;
+        }
+        done += rec;
+        WRITE_ONCE(mf->delivered, mf->delivered + 1);
+    }
+    mutex_unlock(&mf->read_lock);
+
+    if (!done)
+        return ret ? ret : -EAGAIN;
+    return done;
+}
+
+static ssize_t mpu_do_read(struct kiocb *iocb, struct iov_iter *to)
+{
+    struct mpu_file *mf = iocb->ki_filp->private_data;
+    struct mpu_dev *md = mf->md;
+    struct mpu_sample s;
+    int ret = 0;
+    u32 mode;
+
+    if (READ_ONCE(md->dead))
+        return -ENODEV;
+    if (iov_iter_count(to) < mpu_rec_len(READ_ONCE(mf->fmt), iov_iter_count(to)))
+        return -EINVAL;
+
+    mode = READ_ONCE(md->mode);
+    if (mode != MPU_MODE_ONDEMAND)
+        return mpu_ring_read(iocb, to, mode);
+
+    /* at most one burst per sample period, however many files are reading */
+    mpu_warmup_wait(md);
+    mpu_bus_lock(md);
+    s = md->snap.s;
+    if (!s.hdr.version || ktime_get_ns() - s.hdr.timestamp_ns >= NSEC_PER_SEC / md->odr_hz) {
+        ret = mpu_burst_read(md, &s);
+        if (!ret)
+            mpu_publish(md, &s);
+        else
+            WRITE_ONCE(md->ring.hdr->errors, md->ring.hdr->errors + 1);
+    }
+    mutex_unlock(&md->lock);
+
+    if (ret)
+        return -EIO;
+    WRITE_ONCE(mf->cursor, smp_load_acquire(&md->ring.hdr->head));
+    WRITE_ONCE(mf->delivered, mf->delivered + 1);
+
+    s.hdr.timestamp_ns += mpu_clock_offset(mf->clock);
+    return mpu_copy_sample(mf, &s, to);
+}
+
+/*
+ * read() and, through copy_splice_read(), splice() to a pipe: records are
+ * packed straight into the destination pages, so a logger splicing on to
+ * a file never copies them through userspace. Latency (including any wait
+ * for data) goes to debugfs.
+ */
+static ssize_t mpu_chr_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+    struct mpu_file *mf = iocb->ki_filp->private_data;
+    ktime_t t0 = ktime_get();
+    ssize_t ret = mpu_do_read(iocb, to);
+
+    mpu_hist_add(&mf->md->stats.read, ktime_to_ns(ktime_sub(ktime_get(), t0)));
+    trace_mpu6050_read(mf->md->minor, READ_ONCE(mf->md->mode), ret, READ_ONCE(mf->delivered));
+    return ret;
+}
+
+/*
+ * On-demand reads are always ready, FIFO and TIMER mode wait for this
+ * file's watermark and data-ready mode for one record it has not read yet.
+ * An unfetched motion event adds EPOLLPRI in any mode.
+ */
+static __poll_t mpu_chr_poll(struct file *filp, poll_table *wait)
+{
+    struct mpu_file *mf = filp->private_data;
+    struct mpu_dev *md = mf->md;
+    __poll_t mask = 0;
+    bool ready;
+
+    poll_wait(filp, &md->wq, wait);
+    if (READ_ONCE(md->dead))
+        return EPOLLERR | EPOLLHUP;
+
+    switch (READ_ONCE(md->mode)) {
+    case MPU_MODE_FIFO:
+    case MPU_MODE_TIMER:
+        ready = mpu_file_ready(mf, READ_ONCE(md->stream.watermark));
+        break;
+    case MPU_MODE_DRDY:
+        ready = mpu_file_ready(mf, 1);
+        break;
+    default:
+        ready = true;
+    }
+    if (ready)
+        mask |= EPOLLIN | EPOLLRDNORM;
+    if (READ_ONCE(md->motion.count) != READ_ONCE(mf->motion_seen))
+        mask |= EPOLLPRI;
+    return mask;
+}
+
+static long mpu_chr_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+{
+    struct mpu_file *mf = filp->private_data;
+    struct mpu_dev *md = mf->md;
+    u32 __user *uarg = (u32 __user *)arg;
+    u32 val;
+
+    switch (cmd) {
+    case MPU_IOC_SET_FMT:
+        if (get_user(val, uarg))
+            return -EFAULT;
+        if (val != MPU_FMT_LEGACY && val != MPU_FMT_RECORD && val != MPU_FMT_SI)
+            return -EINVAL;
+        mf->fmt = val;
+        return 0;
+    case MPU_IOC_GET_FMT:
+        return put_user(mf->fmt, uarg);
+    case MPU_IOC_SET_MODE:
+        if (get_user(val, uarg))
+            return -EFAULT;
+        return mpu_set_mode(md, val);
+    case MPU_IOC_GET_MODE:
+        return put_user(READ_ONCE(md->mode), uarg);
+    case MPU_IOC_SET_WATERMARK:
+        if (get_user(val, uarg))
+            return -EFAULT;
+        if (!val || val > md->ring.mask + 1)
+            return -EINVAL;
+        WRITE_ONCE(md->stream.watermark, val);
+        wake_up_interruptible(&md->wq);
+        return 0;
+    case MPU_IOC_GET_WATERMARK:
+        return put_user(READ_ONCE(md->stream.watermark), uarg);
+    case MPU_IOC_GET_RING_SIZE:
+        return put_user((u32)md->ring.size, uarg);
+    case MPU_IOC_SET_DECIM:
+        if (get_user(val, uarg))
+            return -EFAULT;
+        if (!val || val > MPU_DECIM_MAX)
+            return -EINVAL;
+        mutex_lock(&mf->read_lock);
+        WRITE_ONCE(mf->decim, val);
+        WRITE_ONCE(mf->skip, 0);
+        mutex_unlock(&mf->read_lock);
+        return 0;
+    case MPU_IOC_GET_DECIM:
+        return put_user(READ_ONCE(mf->decim), uarg);
+    case MPU_IOC_GET_READER_STATS: {
+        struct mpu_reader_stats st;
+
+        memset(&st, 0, sizeof(st));
+        mutex_lock(&mf->read_lock);
+        st.delivered = mf->delivered;
+        st.overruns = mf->overruns;
+        st.avail = READ_ONCE(md->mode) == MPU_MODE_ONDEMAND ? 0 : mpu_file_avail(mf);
+        st.decim = mf->decim;
+        mutex_unlock(&mf->read_lock);
+        return copy_to_user((void __user *)arg, &st, sizeof(st)) ? -EFAULT : 0;
+    }
+    case MPU_IOC_SET_CONFIG: {
+        struct mpu_config c;
+        int ret;
+
+        if (copy_from_user(&c, (void __user *)arg, sizeof(c)))
+            return -EFAULT;
+        ret = mpu_set_config(md, &c);
+        if (ret)
+            return ret;
+        return copy_to_user((void __user *)arg, &c, sizeof(c)) ? -EFAULT : 0;
+    }
+    case MPU_IOC_GET_CONFIG: {
+        struct mpu_config c;
+
+        mpu_get_config(md, &c);
+        return copy_to_user((void __user *)arg, &c, sizeof(c)) ? -EFAULT : 0;
+    }
+    case MPU_IOC_SET_CLOCK:
+        if (get_user(val, uarg))
+            return -EFAULT;
+        if (val != CLOCK_MONOTONIC && val != CLOCK_MONOTONIC_RAW && val != CLOCK_BOOTTIME)
+            return -EINVAL;
+        WRITE_ONCE(mf->clock, val);
+        return 0;
+    case MPU_IOC_GET_CLOCK:
+        return put_user(READ_ONCE(mf->clock), uarg);
+    case MPU_IOC_SET_CHAN_RATES: {
+        struct mpu_chan_rates c;
+
+        if (copy_from_user(&c, (void __user *)arg, sizeof(c)))
+            return -EFAULT;
+        return mpu_set_chan_rates(md, &c);
+    }
+    case MPU_IOC_GET_CHAN_RATES: {
+        struct mpu_chan_rates c;
+
+        mpu_get_chan_rates(md, &c);
+        return copy_to_user((void __user *)arg, &c, sizeof(c)) ? -EFAULT : 0;
+    }
+    case MPU_IOC_SET_CAPTURE: {
+        struct mpu_capture_cfg c;
+
+        if (copy_from_user(&c, (void __user *)arg, sizeof(c)))
+            return -EFAULT;
+        return mpu_set_capture(md, &c);
+    }
+    case MPU_IOC_GET_CAPTURE: {
+        struct mpu_capture_cfg c;
+
+        mpu_get_capture(md, &c);
+        return copy_to_user((void __user *)arg, &c, sizeof(c)) ? -EFAULT : 0;
+    }
+    case MPU_IOC_CAPTURE_TRIGGER:
+        return mpu_capture_trigger(md);
+    case MPU_IOC_SET_ADAPTIVE: {
+        struct mpu_adaptive_cfg c;
+
+        if (copy_from_user(&c, (void __user *)arg, sizeof(c)))
+            return -EFAULT;
+        return mpu_set_adaptive(md, &c);
+    }
+    case MPU_IOC_GET_ADAPTIVE: {
+        struct mpu_adaptive_cfg c;
+
+        mpu_get_adaptive(md, &c);
+        return copy_to_user((void __user *)arg, &c, sizeof(c)) ? -EFAULT : 0;
+    }
+    case MPU_IOC_SET_MOTION: {
+        struct mpu_motion_cfg c;
+
+        if (copy_from_user(&c, (void __user *)arg, sizeof(c)))
+            return -EFAULT;
+        return mpu_set_motion(md, &c);
+    }
+    case MPU_IOC_GET_MOTION: {
+        struct mpu_motion_cfg c;
+
+        mpu_get_motion(md, &c);
+        return copy_to_user((void __user *)arg, &c, sizeof(c)) ? -EFAULT : 0;
+    }
+    case MPU_IOC_GET_MOTION_EVENT: {
+        struct mpu_motion_event ev;
+
+        memset(&ev, 0, sizeof(ev));
+        mutex_lock(&md->lock);
+        ev.timestamp_ns = md->motion.last_ns;
+        ev.count = md->motion.count;
+        ev.missed = ev.count - mf->motion_seen ? ev.count - mf->motion_seen - 1 : 0;
+        mutex_unlock(&md->lock);
+        if (copy_to_user((void __user *)arg, &ev, sizeof(ev)))
+            return -EFAULT;
+        WRITE_ONCE(mf->motion_seen, ev.count);
+        return 0;
+    }
+    case MPU_IOC_SET_FILTER: {
+        struct mpu_filter_cfg c;
+
+        if (copy_from_user(&c, (void __user *)arg, sizeof(c)))
+            return -EFAULT;
+        return mpu_set_filter(md, &c);
+    }
+    case MPU_IOC_GET_FILTER: {
+        struct mpu_filter_cfg c;
+
+        mutex_lock(&md->lock);
+        c = md->filter.cfg;
+        mutex_unlock(&md->lock);
+        return copy_to_user((void __user *)arg, &c, sizeof(c)) ? -EFAULT : 0;
+    }
+    default:
+        return -ENOTTY;
+    }
+}
+
+/* read-only view of the sample ring; pgoff selects the start page */
+static int mpu_chr_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+    struct mpu_file *mf = filp->private_data;
+
+    if (vma->vm_flags & VM_WRITE)
+        return -EPERM;
+    vm_flags_clear(vma, VM_MAYWRITE);
+    return remap_vmalloc_range(vma, mf->md->ring.mem, vma->vm_pgoff);
+}
+
+static void mpu_dev_release(struct kref *ref);
+
+/* minor -> device; a reference keeps it alive until release() */
+static int mpu_chr_open(struct inode *inode, struct file *filp)
+{
+    struct mpu_file *mf;
+    struct mpu_dev *md;
+    int ret;
+
+    mutex_lock(&mpu_devs_lock);
+    md = mpu_devs[iminor(inode) == MPU_COMPAT_MINOR ? 0 : iminor(inode)];
+    if (md)
+        kref_get(&md->ref);
+    mutex_unlock(&mpu_devs_lock);
+    if (!md)
+        return -ENODEV;
+
+    /* the node exists from probe on, the sensor only after bring-up */
+    ret = mpu_wait_ready(md, filp->f_flags & O_NONBLOCK);
+    if (ret) {
+        kref_put(&md->ref, mpu_dev_release);
+        return ret;
+    }
+
+    mf = kzalloc(sizeof(*mf), GFP_KERNEL);
+    if (!mf) {
+        kref_put(&md->ref, mpu_dev_release);
+        return -ENOMEM;
+    }
+    mf->md = md;
+    mutex_init(&mf->read_lock);
+    mf->fmt = MPU_FMT_LEGACY;
+    mf->decim = 1;
+    mf->clock = CLOCK_MONOTONIC;
+    mf->motion_seen = READ_ONCE(md->motion.count);
+    mf->pid = task_tgid_vnr(current);
+    get_task_comm(mf->comm, current);
+    filp->private_data = mf;
+
+    /* wakes the sensor; the first read then waits out the warm-up */
+    ret = mpu_acq_get(md);
+    if (ret) {
+        kfree(mf);
+        kref_put(&md->ref, mpu_dev_release);
+        return ret;
+    }
+
+    /* only samples published from now on */
+    mutex_lock(&md->mode_lock);
+    mf->cursor = smp_load_acquire(&md->ring.hdr->head);
+    list_add_tail(&mf->node, &md->files);
+    mutex_unlock(&md->mode_lock);
+    return 0;
+}
 
-/* module params */
-static int i2c_bus = 1;
-module_param(i2c_bus, int, 0444);
-MODULE_PARM_DESC(i2c_bus, "I2C bus (default 1)");
+static int mpu_chr_release(struct inode *inode, struct file *filp)
+{
+    struct mpu_file *mf = filp->private_data;
+    struct mpu_dev *md = mf->md;
 
-static int i2c_addr = MPU_ADDR_DEFAULT;
-module_param(i2c_addr, int, 0444);
-MODULE_PARM_DESC(i2c_addr, "I2C address (default 0x68)");
+    mutex_lock(&md->mode_lock);
+    list_del(&mf->node);
+    mutex_unlock(&md->mode_lock);
+    mpu_acq_put(md);
+    kfree(mf);
+    kref_put(&md->ref, mpu_dev_release);
+    return 0;
+}
 
-/* global */
-static struct i2c_adapter *mpu_i2c_adapter;
-static struct i2c_client  *mpu_i2c_client;
+static const struct file_operations mpu_fops = {
+    .owner = THIS_MODULE,
+    .open = mpu_chr_open,
+    .release = mpu_chr_release,
+    .read_iter = mpu_chr_read_iter,
+    .splice_read = copy_splice_read,
+    .poll = mpu_chr_poll,
+    .mmap = mpu_chr_mmap,
+    .unlocked_ioctl = mpu_chr_ioctl,
+    .compat_ioctl = compat_ptr_ioctl,
+};
 
-/* char device */
-static dev_t mpu_devt;
-static struct cdev mpu_cdev;
-static struct class *mpu_class;
-static struct mutex mpu_lock; /* protect i2c ops */
+/* ---------- sensor groups ---------- */
+/*
+ * /dev/mpu6050-group samples several sensors on one adapter together: a
+ * file picks its members with MPU_IOC_SET_GROUP and every read() (or
+ * every MPU_IOC_SET_GROUP_RATE tick) issues one combined i2c_transfer
+ * (address + 14-byte read per member, repeated starts in between) and
+ * returns one merged record with a common timestamp, so the skew between
+ * members is a few bytes of bus time.
+ *
+ * One open file is one struct mpu_group. Members are sorted by minor,
+ * which is also the order their device locks are taken in (lockdep
+ * subclass = index, so MPU_GROUP_MAX must stay within
+ * MAX_LOCKDEP_SUBCLASSES).
+ *
+ * With rate_hz set, a private hrtimer + thread (the same split as
+ * MPU_MODE_TIMER) samples all members at every tick and queues the merged
+ * records; read() only drains the queue. Members are held awake with a
+ * runtime PM reference only, so the group never starts their own streams.
+ */
+#define MPU_GROUP_QLEN 64         /* queued tick records, power of two */
 
-/* helper: read 8-bit reg */
-static int mpu_read_reg(u8 reg)
+struct mpu_group {
+    struct mutex ctl;         /* serializes SET_GROUP, SET_GROUP_RATE and release */
+    struct mutex lock;        /* members and the combined transfer */
+    int nr;
+    struct mpu_dev *md[MPU_GROUP_MAX];
+    struct i2c_msg msgs[2 * MPU_GROUP_MAX];
+    u8 reg;                   /* REG_ACCEL_XOUT_H, written to every member */
+    u8 *raw;                  /* MPU_BURST_LEN per member, DMA-safe */
+    u32 seq;
+
+    /* tick mode, started and stopped under ctl */
+    unsigned int rate_hz;     /* 0: one transfer per read() */
+    struct hrtimer timer;
+    struct task_struct *thread;
+    atomic64_t due;           /* deadline of the unserved tick, 0 if none */
+    atomic_t missed;          /* ticks lost since the last record */
+    spinlock_t qlock;
+    struct mpu_group_sample *q; /* MPU_GROUP_QLEN records, under qlock */
+    u32 q_head, q_tail;
+    int err;                  /* last tick failure, reported once the queue is empty */
+    wait_queue_head_t wq;
+};
+
+/* drop the members' references. Caller holds g->lock. */
+static void mpu_group_clear(struct mpu_group *g)
 {
-    return i2c_smbus_read_byte_data(mpu_i2c_client, reg);
+    int i;
+
+    for (i = 0; i < g->nr; i++) {
+        mpu_pm_put(g->md[i]);
+        kref_put(&g->md[i]->ref, mpu_dev_release);
+    }
+    g->nr = 0;
 }
 
-/* helper: write 8-bit reg */
-static int mpu_write_reg(u8 reg, u8 val)
+/* members must share one adapter that can do combined plain-I2C transfers */
+static int mpu_group_set(struct mpu_group *g, const struct mpu_group_cfg *c)
 {
-    return i2c_smbus_write_byte_data(mpu_i2c_client, reg, val);
+    struct mpu_dev *md[MPU_GROUP_MAX];
+    u8 minor[MPU_GROUP_MAX];
+    int i, j, n = 0, ret = 0;
+    u8 t;
+
+    if (!c->nr || c->nr > MPU_GROUP_MAX)
+        return -EINVAL;
+    memcpy(minor, c->minor, c->nr);
+    for (i = 1; i < c->nr; i++)
+        for (j = i; j > 0 && minor[j - 1] > minor[j]; j--) {
+            t = minor[j];
+            minor[j] = minor[j - 1];
+            minor[j - 1] = t;
+        }
+    for (i = 0; i < c->nr; i++)
+        if (minor[i] >= MPU_MAX_DEVICES || (i && minor[i] == minor[i - 1]))
+            return -EINVAL;
+
+    mutex_lock(&mpu_devs_lock);
+    for (n = 0; n < c->nr; n++) {
+        md[n] = mpu_devs[minor[n]];
+        if (!md[n]) {
+            ret = -ENODEV;
+            break;
+        }
+        kref_get(&md[n]->ref);
+    }
+    mutex_unlock(&mpu_devs_lock);
+
+    for (i = 0; !ret && i < n; i++)
+        if (!md[i]->full_i2c || md[i]->client->adapter != md[0]->client->adapter)
+            ret = -EXDEV;
+    /* awake, but no acquisition mode: the combined transfer is the only traffic */
+    for (i = 0; !ret && i < n; i++) {
+        ret = mpu_pm_get(md[i]);
+        if (ret)
+            while (i--)
+                mpu_pm_put(md[i]);
+    }
+    if (ret) {
+        while (n--)
+            kref_put(&md[n]->ref, mpu_dev_release);
+        return ret;
+    }
+
+    mpu_group_clear(g);
+    for (i = 0; i < n; i++) {
+        g->md[i] = md[i];
+        g->msgs[2 * i] = (struct i2c_msg) {
+            .addr = md[i]->client->addr, .flags = 0, .len = 1, .buf = &g->reg,
+        };
+        g->msgs[2 * i + 1] = (struct i2c_msg) {
+            .addr = md[i]->client->addr, .flags = I2C_M_RD, .len = MPU_BURST_LEN,
+            .buf = g->raw + i * MPU_BURST_LEN,
+        };
+    }
+    g->nr = n;
+    return 0;
 }
 
-/* helper: read 16-bit (big-endian) from reg_hi */
-static int mpu_read16(u8 reg_hi, s16 *out)
+/* one combined transfer into a merged record. Caller holds g->lock, g->nr != 0. */
+static int mpu_group_acquire(struct mpu_group *g, struct mpu_group_sample *rec)
 {
-    int hi, lo;
-    hi = mpu_read_reg(reg_hi);
-    if (hi < 0) return hi;
-    lo = mpu_read_reg(reg_hi + 1);
-    if (lo < 0) return lo;
-    *out = (s16)((hi << 8) | lo);
+    struct mpu_group_member *m;
+    const u8 *raw;
+    u64 t0 = 0, t1 = 0;
+    int i, k, ret = 0;
+
+    memset(rec, 0, sizeof(*rec));
+    for (i = 0; i < g->nr; i++)
+        mpu_warmup_wait(g->md[i]);
+    for (i = 0; i < g->nr; i++)
+        mutex_lock_nested(&g->md[i]->lock, i);
+    for (i = 0; i < g->nr; i++) {
+        if (g->md[i]->dead)
+            ret = -ENODEV;
+        rec->member[i].minor = g->md[i]->minor;
+        rec->member[i].accel_fs = g->md[i]->cfg.accel_fs;
+        rec->member[i].gyro_fs = g->md[i]->cfg.gyro_fs;
+    }
+    if (!ret) {
+        t0 = ktime_get_ns();
+        ret = i2c_transfer(g->md[0]->client->adapter, g->msgs, 2 * g->nr);
+        t1 = ktime_get_ns();
+        mpu_hist_add(&g->md[0]->stats.bus, t1 - t0);
+        if (ret >= 0)
+            ret = ret == 2 * g->nr ? 0 : -EIO;
+    }
+    for (i = g->nr - 1; i >= 0; i--)
+        mutex_unlock(&g->md[i]->lock);
+    if (ret)
+        return ret;
+
+    rec->version = MPU_REC_VERSION;
+    rec->size = offsetof(struct mpu_group_sample, member) + g->nr * sizeof(rec->member[0]);
+    rec->seq = g->seq++;
+    rec->timestamp_ns = t0;
+    rec->span_ns = min_t(u64, t1 - t0, U32_MAX);
+    rec->nr = g->nr;
+    for (i = 0; i < g->nr; i++) {
+        m = &rec->member[i];
+        raw = g->raw + i * MPU_BURST_LEN;
+        for (k = 0; k < 3; k++) {
+            m->accel[k] = (s16)((raw[2 * k] << 8) | raw[2 * k + 1]);
+            m->gyro[k]  = (s16)((raw[8 + 2 * k] << 8) | raw[9 + 2 * k]);
+        }
+        m->temp = (s16)((raw[6] << 8) | raw[7]);
+    }
     return 0;
 }
 
-/* ---------- sysfs show functions (reuse code from you) ---------- */
-static inline long labs_long(long v) { return v < 0 ? -v : v; }
+/* hard irq: post the deadline and wake the group thread */
+static enum hrtimer_restart mpu_group_fire(struct hrtimer *t)
+{
+    struct mpu_group *g = container_of(t, struct mpu_group, timer);
+    u64 due = ktime_to_ns(hrtimer_get_expires(t));
+    u64 missed;
+
+    missed = atomic64_xchg(&g->due, due) ? 1 : 0;
+    missed += hrtimer_forward_now(t, ns_to_ktime(div_u64(NSEC_PER_SEC, g->rate_hz))) - 1;
+    if (missed)
+        atomic_add(missed, &g->missed);
+    wake_up_process(g->thread);
+    return HRTIMER_RESTART;
+}
 
-static ssize_t accel_x_show(struct device *dev, struct device_attribute *attr, char *buf)
+/* sample every member and queue the record; a full queue loses its oldest */
+static void mpu_group_tick(struct mpu_group *g)
 {
-    s16 raw;
-    long ms2_x1000;
-    if (mpu_read16(REG_ACCEL_XOUT_H, &raw))
-        return -EIO;
-    ms2_x1000 = (long)raw * 9807 / ACCEL_SENS_2G;
-    return sprintf(buf, "%d\t%ld.%03ld\n", (int)raw, ms2_x1000 / 1000, labs_long(ms2_x1000 % 1000));
+    struct mpu_group_sample rec;
+    int ret;
+
+    mutex_lock(&g->lock);
+    ret = g->nr ? mpu_group_acquire(g, &rec) : -EDESTADDRREQ;
+    mutex_unlock(&g->lock);
+
+    spin_lock(&g->qlock);
+    if (ret) {
+        g->err = ret;
+    } else {
+        if (atomic_xchg(&g->missed, 0))
+            rec.flags |= MPU_REC_F_GAP;
+        if (g->q_head - g->q_tail == MPU_GROUP_QLEN) {
+            g->q_tail++;
+            g->q[g->q_tail & (MPU_GROUP_QLEN - 1)].flags |= MPU_REC_F_GAP;
+        }
+        g->q[g->q_head++ & (MPU_GROUP_QLEN - 1)] = rec;
+    }
+    spin_unlock(&g->qlock);
+    wake_up_interruptible(&g->wq);
 }
-static ssize_t accel_y_show(struct device *dev, struct device_attribute *attr, char *buf)
+
+static int mpu_group_thread(void *data)
 {
-    s16 raw;
-    long ms2_x1000;
-    if (mpu_read16(REG_ACCEL_XOUT_H + 2, &raw))
-        return -EIO;
-    ms2_x1000 = (long)raw * 9807 / ACCEL_SENS_2G;
-    return sprintf(buf, "%d\t%ld.%03ld\n", (int)raw, ms2_x1000 / 1000, labs_long(ms2_x1000 % 1000));
+    struct mpu_group *g = data;
+
+    for (;;) {
+        set_current_state(TASK_INTERRUPTIBLE);
+        if (kthread_should_stop())
+            break;
+        if (!atomic64_xchg(&g->due, 0)) {
+            schedule();
+            continue;
+        }
+        __set_current_state(TASK_RUNNING);
+        mpu_group_tick(g);
+    }
+    __set_current_state(TASK_RUNNING);
+    return 0;
 }
-static ssize_t accel_z_show(struct device *dev, struct device_attribute *attr, char *buf)
+
+/* caller holds g->ctl */
+static int mpu_group_tick_start(struct mpu_group *g)
 {
-    s16 raw;
-    long ms2_x1000;
-    if (mpu_read16(REG_ACCEL_XOUT_H + 4, &raw))
-        return -EIO;
-    ms2_x1000 = (long)raw * 9807 / ACCEL_SENS_2G;
-    return sprintf(buf, "%d\t%ld.%03ld\n", (int)raw, ms2_x1000 / 1000, labs_long(ms2_x1000 % 1000));
+    struct task_struct *t;
+
+    if (g->thread || !g->rate_hz || !g->nr)
+        return 0;
+    t = kthread_create(mpu_group_thread, g, DEVICE_NAME "-group");
+    if (IS_ERR(t))
+        return PTR_ERR(t);
+    if (timer_cpu >= 0 && timer_cpu < nr_cpu_ids && cpu_online(timer_cpu))
+        kthread_bind(t, timer_cpu);
+    if (timer_rt)
+        sched_set_fifo(t);
+
+    atomic64_set(&g->due, 0);
+    atomic_set(&g->missed, 0);
+    g->thread = t;
+    wake_up_process(t);
+    hrtimer_start(&g->timer, ktime_add_ns(ktime_get(), div_u64(NSEC_PER_SEC, g->rate_hz)),
+                  HRTIMER_MODE_ABS_HARD);
+    return 0;
 }
-static ssize_t temp_show(struct device *dev, struct device_attribute *attr, char *buf)
+
+/* caller holds g->ctl; queued records belong to the old setup and go too */
+static void mpu_group_tick_stop(struct mpu_group *g)
 {
-    s16 raw;
-    long tmp_x100;
-    if (mpu_read16(REG_TEMP_OUT_H, &raw))
-        return -EIO;
-    tmp_x100 = ((long)raw * 100 / 340) + 3653;
-    return sprintf(buf, "%d\t%ld.%02ld\n", (int)raw, tmp_x100/100, labs_long(tmp_x100%100));
+    if (g->thread) {
+        hrtimer_cancel(&g->timer);
+        kthread_stop(g->thread);
+        g->thread = NULL;
+    }
+    spin_lock(&g->qlock);
+    g->q_head = g->q_tail = 0;
+    g->err = 0;
+    spin_unlock(&g->qlock);
+    wake_up_interruptible(&g->wq);
 }
-static ssize_t gyro_x_show(struct device *dev, struct device_attribute *attr, char *buf)
+
+static bool mpu_group_queued(struct mpu_group *g)
 {
-    s16 raw; long dps_x100;
-    if (mpu_read16(REG_GYRO_XOUT_H, &raw)) return -EIO;
-    dps_x100 = (long)raw * 100 / GYRO_SENS_250;
-    return sprintf(buf, "%d\t%ld.%02ld\n", (int)raw, dps_x100/100, labs_long(dps_x100%100));
+    bool ready;
+
+    spin_lock(&g->qlock);
+    ready = g->q_head != g->q_tail || g->err;
+    spin_unlock(&g->qlock);
+    return ready;
 }
-static ssize_t gyro_y_show(struct device *dev, struct device_attribute *attr, char *buf)
+
+/* tick mode: hand out queued records, as many as fit */
+static ssize_t mpu_group_drain(struct file *filp, char __user *buf, size_t count)
 {
-    s16 raw; long dps_x100;
-    if (mpu_read16(REG_GYRO_XOUT_H + 2, &raw)) return -EIO;
-    dps_x100 = (long)raw * 100 / GYRO_SENS_250;
-    return sprintf(buf, "%d\t%ld.%02ld\n", (int)raw, dps_x100/100, labs_long(dps_x100%100));
+    struct mpu_group *g = filp->private_data;
+    struct mpu_group_sample rec;
+    size_t done = 0;
+    int ret;
+
+    if (!mpu_group_queued(g)) {
+        if (filp->f_flags & O_NONBLOCK)
+            return -EAGAIN;
+        ret = wait_event_interruptible(g->wq, mpu_group_queued(g) || !READ_ONCE(g->thread));
+        if (ret)
+            return ret;
+        if (!mpu_group_queued(g)) {
+            /* no tick: let a reconfiguration finish, then see what is left */
+            if (mutex_lock_interruptible(&g->ctl))
+                return -ERESTARTSYS;
+            ret = g->rate_hz && !g->thread ? -EDESTADDRREQ : -EAGAIN;
+            mutex_unlock(&g->ctl);
+            return ret;
+        }
+    }
+    for (;;) {
+        spin_lock(&g->qlock);
+        if (g->q_head == g->q_tail) {
+            ret = g->err;
+            g->err = 0;
+            spin_unlock(&g->qlock);
+            break;
+        }
+        rec = g->q[g->q_tail & (MPU_GROUP_QLEN - 1)];
+        if (rec.size > count - done) {
+            spin_unlock(&g->qlock);
+            ret = done ? 0 : -EINVAL;
+            break;
+        }
+        g->q_tail++;
+        spin_unlock(&g->qlock);
+        if (copy_to_user(buf + done, &rec, rec.size)) {
+            ret = -EFAULT;
+            break;
+        }
+        done += rec.size;
+    }
+    if (done)
+        return done;
+    return ret ? ret : -EAGAIN;
 }
-static ssize_t gyro_z_show(struct device *dev, struct device_attribute *attr, char *buf)
+
+static ssize_t mpu_group_read(struct file *filp, char __user *buf, size_t count, loff_t *f_pos)
 {
-    s16 raw; long dps_x100;
-    if (mpu_read16(REG_GYRO_XOUT_H + 4, &raw)) return -EIO;
-    dps_x100 = (long)raw * 100 / GYRO_SENS_250;
-    return sprintf(buf, "%d\t%ld.%02ld\n", (int)raw, dps_x100/100, labs_long(dps_x100%100));
+    struct mpu_group *g = filp->private_data;
+    struct mpu_group_sample rec;
+    int ret;
+
+    /* a blocking reader woken by a rate change retries under the new one */
+    while (READ_ONCE(g->rate_hz)) {
+        ret = mpu_group_drain(filp, buf, count);
+        if (ret != -EAGAIN || (filp->f_flags & O_NONBLOCK))
+            return ret;
+    }
+
+    if (mutex_lock_interruptible(&g->lock))
+        return -ERESTARTSYS;
+    if (!g->nr)
+        ret = -EDESTADDRREQ;
+    else if (count < offsetof(struct mpu_group_sample, member) + g->nr * sizeof(rec.member[0]))
+        ret = -EINVAL;
+    else
+        ret = mpu_group_acquire(g, &rec);
+    mutex_unlock(&g->lock);
+    if (ret)
+        return ret;
+    return copy_to_user(buf, &rec, rec.size) ? -EFAULT : rec.size;
 }
 
-/* device attrs */
-static DEVICE_ATTR_RO(accel_x);
-static DEVICE_ATTR_RO(accel_y);
-static DEVICE_ATTR_RO(accel_z);
-static DEVICE_ATTR_RO(temp);
-static DEVICE_ATTR_RO(gyro_x);
-static DEVICE_ATTR_RO(gyro_y);
-static DEVICE_ATTR_RO(gyro_z);
+static __poll_t mpu_group_poll(struct file *filp, poll_table *wait)
+{
+    struct mpu_group *g = filp->private_data;
 
-/* ---------- char device operations ---------- */
-static ssize_t mpu_chr_read(struct file *filp, char __user *buf, size_t count, loff_t *f_pos)
+    poll_wait(filp, &g->wq, wait);
+    if (!READ_ONCE(g->rate_hz) || !READ_ONCE(g->thread) || mpu_group_queued(g))
+        return EPOLLIN | EPOLLRDNORM;
+    return 0;
+}
+
+static long mpu_group_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 {
-    s16 ax, ay, az;
-    u8 out[6];
-    int ret;
-    ktime_t t0, t1;
-    s64 us;
+    struct mpu_group *g = filp->private_data;
+    struct mpu_group_cfg c;
+    u32 __user *uarg = (u32 __user *)arg;
+    u32 val;
+    int i, ret;
 
-    if (count < 6)
-        return -EINVAL;
+    switch (cmd) {
+    case MPU_IOC_SET_GROUP:
+        if (copy_from_user(&c, (void __user *)arg, sizeof(c)))
+            return -EFAULT;
+        mutex_lock(&g->ctl);
+        mpu_group_tick_stop(g);
+        mutex_lock(&g->lock);
+        ret = mpu_group_set(g, &c);
+        mutex_unlock(&g->lock);
+        if (!ret)
+            ret = mpu_group_tick_start(g);
+        mutex_unlock(&g->ctl);
+        return ret;
+    case MPU_IOC_GET_GROUP:
+        memset(&c, 0, sizeof(c));
+        mutex_lock(&g->lock);
+        c.nr = g->nr;
+        for (i = 0; i < g->nr; i++)
+            c.minor[i] = g->md[i]->minor;
+        mutex_unlock(&g->lock);
+        return copy_to_user((void __user *)arg, &c, sizeof(c)) ? -EFAULT : 0;
+    case MPU_IOC_SET_GROUP_RATE:
+        if (get_user(val, uarg))
+            return -EFAULT;
+        if (val > MPU_GROUP_MAX_HZ)
+            return -EINVAL;
+        mutex_lock(&g->ctl);
+        mpu_group_tick_stop(g);
+        WRITE_ONCE(g->rate_hz, val);
+        ret = mpu_group_tick_start(g);
+        if (ret)
+            WRITE_ONCE(g->rate_hz, 0);
+        mutex_unlock(&g->ctl);
+        return ret;
+    case MPU_IOC_GET_GROUP_RATE:
+        return put_user(READ_ONCE(g->rate_hz), uarg);
+    default:
+        return -ENOTTY;
+    }
+}
 
-    mutex_lock(&mpu_lock);
-    t0 = ktime_get();
-    ret = mpu_read16(REG_ACCEL_XOUT_H, &ax);
-    if (!ret) mpu_read16(REG_ACCEL_XOUT_H + 2, &ay);
-    if (!ret) mpu_read16(REG_ACCEL_XOUT_H + 4, &az);
-    t1 = ktime_get();
-    mutex_unlock(&mpu_lock);
+static int mpu_group_open(struct inode *inode, struct file *filp)
+{
+    struct mpu_group *g;
 
-    if (ret)
-        return -EIO;
+    g = kzalloc(sizeof(*g), GFP_KERNEL);
+    if (!g)
+        return -ENOMEM;
+    g->raw = kmalloc(MPU_GROUP_MAX * MPU_BURST_LEN, GFP_KERNEL);
+    g->q = kmalloc_array(MPU_GROUP_QLEN, sizeof(*g->q), GFP_KERNEL);
+    if (!g->raw || !g->q) {
+        kfree(g->q);
+        kfree(g->raw);
+        kfree(g);
+        return -ENOMEM;
+    }
+    mutex_init(&g->ctl);
+    mutex_init(&g->lock);
+    spin_lock_init(&g->qlock);
+    init_waitqueue_head(&g->wq);
+    hrtimer_setup(&g->timer, mpu_group_fire, CLOCK_MONOTONIC, HRTIMER_MODE_ABS_HARD);
+    g->reg = REG_ACCEL_XOUT_H;
+    filp->private_data = g;
+    return 0;
+}
 
-    /* pack into little-endian bytes */
-    out[0] = ax & 0xFF; out[1] = (ax >> 8) & 0xFF;
-    out[2] = ay & 0xFF; out[3] = (ay >> 8) & 0xFF;
-    out[4] = az & 0xFF; out[5] = (az >> 8) & 0xFF;
+static int mpu_group_release(struct inode *inode, struct file *filp)
+{
+    struct mpu_group *g = filp->private_data;
 
-    if (copy_to_user(buf, out, 6))
-        return -EFAULT;
+    mutex_lock(&g->ctl);
+    mpu_group_tick_stop(g);
+    mutex_lock(&g->lock);
+    mpu_group_clear(g);
+    mutex_unlock(&g->lock);
+    mutex_unlock(&g->ctl);
+    kfree(g->q);
+    kfree(g->raw);
+    kfree(g);
+    return 0;
+}
+
+static const struct file_operations mpu_group_fops = {
+    .owner = THIS_MODULE,
+    .open = mpu_group_open,
+    .release = mpu_group_release,
+    .read = mpu_group_read,
+    .poll = mpu_group_poll,
+    .unlocked_ioctl = mpu_group_ioctl,
+    .compat_ioctl = compat_ptr_ioctl,
+};
+
+/* ---------- debugfs ---------- */
+/* mpu6050_kmod/<i2c dev>/stats: bus, read() and bus lock wait histograms */
+static void mpu_hist_show(struct seq_file *m, const char *name, struct mpu_hist *h)
+{
+    s64 n = atomic64_read(&h->count);
+    int i;
 
-    /* we could expose read latency via poll/ioctl; user-space measures it too */
-    us = ktime_to_us(ktime_sub(t1, t0));
-    /* put latency in kernel log occasionally? commented out by default */
-    /* dev_dbg(&mpu_i2c_client->dev, "i2c read latency: %lld us\n", us); */
+    seq_printf(m, "%s: count %lld", name, n);
+    if (n)
+        seq_printf(m, " min %lld avg %lld max %lld ns",
+                   atomic64_read(&h->min_ns),
+                   div64_s64(atomic64_read(&h->sum_ns), n),
+                   atomic64_read(&h->max_ns));
+    seq_puts(m, "\n");
+    for (i = 0; i < MPU_HIST_BUCKETS; i++) {
+        long c = atomic_long_read(&h->bucket[i]);
 
-    return 6;
+        if (!c)
+            continue;
+        if (i == 0)
+            seq_printf(m, "  %10s < 1 us: %ld\n", "", c);
+        else
+            seq_printf(m, "  %8lu - %lu us: %ld\n", 1UL << (i - 1), (1UL << i) - 1, c);
+    }
 }
 
-static int mpu_chr_open(struct inode *inode, struct file *filp)
+static int mpu_stats_show(struct seq_file *m, void *v)
 {
-    filp->private_data = mpu_i2c_client;
+    struct mpu_dev *md = m->private;
+
+    seq_printf(m, "errors: %ld\nretries: %ld\n",
+               atomic_long_read(&md->stats.errors), atomic_long_read(&md->stats.retries));
+    mpu_hist_show(m, "bus", &md->stats.bus);
+    mpu_hist_show(m, "read", &md->stats.read);
+    mpu_hist_show(m, "lock_wait", &md->stats.lock_wait);
+    mpu_hist_show(m, "wake", &md->stats.wake);
+    seq_printf(m, "timer_missed: %ld\n", atomic_long_read(&md->stats.timer_missed));
+    mpu_hist_show(m, "timer_jitter", &md->stats.timer_jitter);
+    seq_printf(m, "adaptive_switches: %lu\n", READ_ONCE(md->adapt.switches));
     return 0;
 }
+DEFINE_SHOW_ATTRIBUTE(mpu_stats);
 
-static const struct file_operations mpu_fops = {
+/* one line per open file: who reads, at what decimation, and what it lost */
+static int mpu_readers_show(struct seq_file *m, void *v)
+{
+    struct mpu_dev *md = m->private;
+    struct mpu_file *mf;
+
+    seq_puts(m, "pid\tcomm\tdecim\tavail\tdelivered\toverruns\n");
+    mutex_lock(&md->mode_lock);
+    list_for_each_entry(mf, &md->files, node)
+        seq_printf(m, "%d\t%s\t%u\t%u\t%llu\t%llu\n", mf->pid, mf->comm,
+                   READ_ONCE(mf->decim), mpu_file_avail(mf),
+                   READ_ONCE(mf->delivered), READ_ONCE(mf->overruns));
+    mutex_unlock(&md->mode_lock);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(mpu_readers);
+
+static void mpu_stats_reset(struct mpu_dev *md)
+{
+    mpu_hist_reset(&md->stats.bus);
+    mpu_hist_reset(&md->stats.read);
+    mpu_hist_reset(&md->stats.lock_wait);
+    mpu_hist_reset(&md->stats.wake);
+    mpu_hist_reset(&md->stats.timer_jitter);
+    atomic_long_set(&md->stats.timer_missed, 0);
+    atomic_long_set(&md->stats.errors, 0);
+    atomic_long_set(&md->stats.retries, 0);
+}
+
+/* any write to "reset" clears every counter */
+static ssize_t mpu_stats_reset_write(struct file *file, const char __user *buf,
+                                     size_t count, loff_t *ppos)
+{
+    struct mpu_dev *md = file->private_data;
+
+    mpu_stats_reset(md);
+    return count;
+}
+
+static const struct file_operations mpu_stats_reset_fops = {
     .owner = THIS_MODULE,
-    .open = mpu_chr_open,
-    .read = mpu_chr_read,
+    .open = simple_open,
+    .write = mpu_stats_reset_write,
+    .llseek = noop_llseek,
 };
 
+static void mpu_debugfs_init(struct mpu_dev *md)
+{
+    md->debugfs_dir = debugfs_create_dir(dev_name(&md->client->dev), mpu_debugfs_root);
+    debugfs_create_file("stats", 0444, md->debugfs_dir, md, &mpu_stats_fops);
+    debugfs_create_file("readers", 0444, md->debugfs_dir, md, &mpu_readers_fops);
+    debugfs_create_file("reset", 0200, md->debugfs_dir, md, &mpu_stats_reset_fops);
+}
+
+
 /* ---------- i2c probe/remove ---------- */
-/* note: Raspberry Pi setup expects probe signature with single arg when using manual client */
-static int mpu_probe(struct i2c_client *client)
+/*
+ * All state lives in a per-device struct mpu_dev with its own bus lock, so
+ * sensors on different adapters are sampled concurrently. Probe is
+ * asynchronous and does no bus traffic: WHO_AM_I, wake-up, the initial
+ * configuration and the INT setup run from a work item. Until it
+ * finishes, open() blocks (-EAGAIN with O_NONBLOCK) and so does anything
+ * else that needs the bus; probe_ready_us reports how long it took.
+ */
+/* last reference gone: no file, IIO buffer or irq can touch md any more */
+static void mpu_dev_release(struct kref *ref)
 {
-    int who, ret;
+    struct mpu_dev *md = container_of(ref, struct mpu_dev, ref);
+
+    /* nothing may still run on md */
+    cancel_work_sync(&md->adapt.work);
+    cancel_work_sync(&md->capture.work);
+    kfree(md->stream.chunk);
+    vfree(md->ring.mem);
+    vfree(md->capture.buf);
+    put_device(&md->client->dev);
+    kfree(md);
+}
+
+static void mpu_remove_files(struct device *dev)
+{
+    device_remove_file(dev, &dev_attr_accel_x);
+    device_remove_file(dev, &dev_attr_accel_y);
+    device_remove_file(dev, &dev_attr_accel_z);
+    device_remove_file(dev, &dev_attr_temp);
+    device_remove_file(dev, &dev_attr_gyro_x);
+    device_remove_file(dev, &dev_attr_gyro_y);
+    device_remove_file(dev, &dev_attr_gyro_z);
+    device_remove_file(dev, &dev_attr_all);
+    device_remove_file(dev, &dev_attr_snapshot_max_age_ms);
+    device_remove_file(dev, &dev_attr_sample_rate_hz);
+    device_remove_file(dev, &dev_attr_dlpf);
+    device_remove_file(dev, &dev_attr_accel_range_g);
+    device_remove_file(dev, &dev_attr_gyro_range_dps);
+    device_remove_file(dev, &dev_attr_warmup_ms);
+    device_remove_file(dev, &dev_attr_wake_latency_us);
+    device_remove_file(dev, &dev_attr_probe_ready_us);
+    device_remove_file(dev, &dev_attr_timer_rate_hz);
+    device_remove_file(dev, &dev_attr_sample_clock_ppm);
+    device_remove_file(dev, &dev_attr_activity_mg);
+    device_remove_bin_file(dev, &bin_attr_capture);
+}
 
-    mpu_i2c_client = client;
+/*
+ * Deferred bring-up: everything that needs the bus at bind time. probe() left a runtime PM
+ * reference for us, so the sensor cannot be suspended underneath.
+ */
+static void mpu_boot_work(struct work_struct *work)
+{
+    struct mpu_dev *md = container_of(work, struct mpu_dev, boot.work);
+    struct i2c_client *client = md->client;
+    struct mpu_hw_cfg c;
+    int who, ret;
 
-    who = mpu_read_reg(REG_WHO_AM_I);
+    mutex_lock(&md->lock);
+    who = mpu_read_reg(md, REG_WHO_AM_I);
     if (who < 0) {
         dev_err(&client->dev, "Failed to read WHO_AM_I\n");
-        return -EIO;
+        ret = -EIO;
+        goto out;
     }
     dev_info(&client->dev, "WHO_AM_I = 0x%02x\n", who);
 
     /* wake up */
-    ret = mpu_write_reg(REG_PWR_MGMT_1, 0x00);
-    if (ret < 0) return ret;
+    ret = mpu_write_reg(md, REG_PWR_MGMT_1, 0x00);
+    if (ret < 0)
+        goto out;
+    md->pm.ready_ns = ktime_get_ns() + (u64)md->pm.warmup_ms * NSEC_PER_MSEC;
     msleep(10);
-    /* basic config */
-    mpu_write_reg(0x19, 0x07); /* SMPLRT_DIV */
-    mpu_write_reg(0x1A, 0x01); /* CONFIG */
-    mpu_write_reg(0x1B, 0x00); /* GYRO_CONFIG */
-    mpu_write_reg(0x1C, 0x00); /* ACCEL_CONFIG */
+    c = md->cfg;
+    ret = mpu_apply_config(md, &c);
+    md->cfg_changed = false;
+out:
+    mutex_unlock(&md->lock);
+
+    if (!ret) {
+        /* optional data-ready interrupt; without it reads go to the bus */
+        if (mpu_drdy_setup(md))
+            dev_warn(&client->dev, "no data-ready interrupt, polling the bus\n");
+        WRITE_ONCE(md->mode, mpu_default_mode(md));
+    }
+    md->boot.err = ret;
+    WRITE_ONCE(md->boot.ready_us, div_u64(ktime_get_ns() - md->boot.probe_ns, NSEC_PER_USEC));
+    complete_all(&md->boot.done);
+    if (ret)
+        dev_err(&client->dev, "bring-up failed (%d)\n", ret);
+    else
+        dev_info(&client->dev, "MPU6050 initialized OK, %u us after probe\n", md->boot.ready_us);
+
+    /* sleeps after the autosuspend delay unless opened */
+    mpu_pm_put(md);
+}
+
+/* note: Raspberry Pi setup expects probe signature with single arg when using manual client */
+static int mpu_probe(struct i2c_client *client)
+{
+    struct device *node;
+    struct mpu_dev *md;
+    int ret;
+
+    BUILD_BUG_ON(sizeof(struct mpu_sample_hdr) != 24);
+    BUILD_BUG_ON(sizeof(struct mpu_sample) != 40);
+    BUILD_BUG_ON(sizeof(struct mpu_sample_si) != 56);
+
+    if (!i2c_check_functionality(client->adapter, I2C_FUNC_SMBUS_READ_I2C_BLOCK)) {
+        dev_err(&client->dev, "adapter lacks I2C block reads\n");
+        return -EOPNOTSUPP;
+    }
+
+    md = kzalloc(sizeof(*md), GFP_KERNEL);
+    if (!md)
+        return -ENOMEM;
+    /* open files may call into runtime PM after unbind */
+    md->client = client;
+    get_device(&client->dev);
+    md->full_i2c = i2c_check_functionality(client->adapter, I2C_FUNC_I2C);
+    kref_init(&md->ref);
+    mutex_init(&md->lock);
+    mutex_init(&md->mode_lock);
+    mutex_init(&md->capture.lock);
+    INIT_LIST_HEAD(&md->files);
+    init_waitqueue_head(&md->wq);
+    seqcount_mutex_init(&md->snap.seq, &md->lock);
+    md->snap.max_age_ms = 10;
+    md->pm.warmup_ms = MPU_WARMUP_MS_INIT;
+    md->filter.cfg.decim = 1;
+    mpu_stats_reset(md);
+    md->boot.probe_ns = ktime_get_ns();
+    INIT_WORK(&md->boot.work, mpu_boot_work);
+    INIT_WORK(&md->adapt.work, mpu_adapt_work);
+    INIT_WORK(&md->capture.work, mpu_capture_work);
+    init_completion(&md->boot.done);
+    i2c_set_clientdata(client, md);
+
+    md->regmap = devm_regmap_init_i2c(client, &mpu_regmap_config);
+    if (IS_ERR(md->regmap)) {
+        ret = PTR_ERR(md->regmap);
+        goto err_free;
+    }
+
+    md->minor = ida_alloc_max(&mpu_minors, MPU_MAX_DEVICES - 1, GFP_KERNEL);
+    if (md->minor < 0) {
+        dev_err(&client->dev, "more than %d sensors\n", MPU_MAX_DEVICES);
+        ret = md->minor;
+        goto err_free;
+    }
+
+    /* basic config: 125 Hz, 184 Hz DLPF, +-2 g, +-250 deg/s; written by mpu_boot_work() */
+    md->cfg.smplrt_div = MPU_SMPLRT_DIV_INIT;
+    md->cfg.dlpf = MPU_DLPF_CFG_INIT;
+    md->cfg.accel_fs = MPU_ACCEL_FS_2G;
+    md->cfg.gyro_fs = MPU_GYRO_FS_250;
+    md->odr_hz = mpu_calc_odr(md->cfg.smplrt_div, md->cfg.dlpf);
+
+    /* FIFO streaming state (idle until MPU_IOC_SET_MODE) */
+    INIT_DELAYED_WORK(&md->stream.work, mpu_stream_work);
+    hrtimer_setup(&md->timer.timer, mpu_timer_fire, CLOCK_MONOTONIC, HRTIMER_MODE_ABS_HARD);
+    md->stream.watermark = 32;
+    /* not devm: an open file may outlive the binding */
+    ret = -ENOMEM;
+    md->stream.chunk = kmalloc(MPU_FIFO_CHUNK_FRAMES * MPU_BURST_LEN, GFP_KERNEL);
+    if (!md->stream.chunk)
+        goto err_minor;
+    ret = mpu_ring_alloc(md, ring_slots);
+    if (ret)
+        goto err_minor;
+    md->stream.watermark = min(md->stream.watermark, md->ring.mask + 1);
+    mpu_chan_fifo_layout(md);
+    md->mode = MPU_MODE_ONDEMAND;
 
     /* create sysfs attrs on this device */
     device_create_file(&client->dev, &dev_attr_accel_x);
@@ -234,55 +4344,113 @@ static int mpu_probe(struct i2c_client *client)
     device_create_file(&client->dev, &dev_attr_gyro_x);
     device_create_file(&client->dev, &dev_attr_gyro_y);
     device_create_file(&client->dev, &dev_attr_gyro_z);
+    device_create_file(&client->dev, &dev_attr_all);
+    device_create_file(&client->dev, &dev_attr_snapshot_max_age_ms);
+    device_create_file(&client->dev, &dev_attr_sample_rate_hz);
+    device_create_file(&client->dev, &dev_attr_dlpf);
+    device_create_file(&client->dev, &dev_attr_accel_range_g);
+    device_create_file(&client->dev, &dev_attr_gyro_range_dps);
+    device_create_file(&client->dev, &dev_attr_warmup_ms);
+    device_create_file(&client->dev, &dev_attr_wake_latency_us);
+    device_create_file(&client->dev, &dev_attr_probe_ready_us);
+    device_create_file(&client->dev, &dev_attr_timer_rate_hz);
+    device_create_file(&client->dev, &dev_attr_sample_clock_ppm);
+    device_create_file(&client->dev, &dev_attr_activity_mg);
+    device_create_bin_file(&client->dev, &bin_attr_capture);
 
-    dev_info(&client->dev, "MPU6050 initialized OK\n");
-
-    /* register char device dynamically */
-    if (alloc_chrdev_region(&mpu_devt, 0, 1, DEVICE_NAME) < 0) {
-        dev_err(&client->dev, "alloc_chrdev_region failed\n");
-        return -ENOMEM;
-    }
-    cdev_init(&mpu_cdev, &mpu_fops);
-    mpu_cdev.owner = THIS_MODULE;
-    if (cdev_add(&mpu_cdev, mpu_devt, 1) < 0) {
-        unregister_chrdev_region(mpu_devt, 1);
-        dev_err(&client->dev, "cdev_add failed\n");
-        return -EINVAL;
-    }
-    mpu_class = class_create(DEVICE_NAME);
-    if (IS_ERR(mpu_class)) {
-        cdev_del(&mpu_cdev);
-        unregister_chrdev_region(mpu_devt, 1);
-        dev_err(&client->dev, "class_create failed\n");
-        return PTR_ERR(mpu_class);
-    }
-    if (!device_create(mpu_class, &client->dev, mpu_devt, NULL, DEVICE_NAME)) {
-        dev_info(&client->dev, "Created /dev/%s\n", DEVICE_NAME);
-    } else {
+    node = device_create(mpu_class, &client->dev, MKDEV(MAJOR(mpu_devt), md->minor), md,
+                         DEVICE_NAME "-%d", md->minor);
+    if (IS_ERR(node)) {
         dev_err(&client->dev, "device_create failed\n");
+        ret = PTR_ERR(node);
+        goto err_files;
     }
+    dev_info(&client->dev, "Created /dev/%s-%d\n", DEVICE_NAME, md->minor);
+    /* the pre multi-sensor name; a missing alias is not fatal */
+    if (md->minor == 0 &&
+        IS_ERR(device_create(mpu_class, &client->dev, MKDEV(MAJOR(mpu_devt), MPU_COMPAT_MINOR),
+                             md, DEVICE_NAME)))
+        dev_warn(&client->dev, "could not create /dev/%s\n", DEVICE_NAME);
 
-    mutex_init(&mpu_lock);
+    mpu_debugfs_init(md);
 
+    /* IIO runs next to /dev/mpu6050-N; losing it is not fatal */
+    ret = mpu_iio_setup(md);
+    if (ret)
+        dev_warn(&client->dev, "IIO registration failed (%d)\n", ret);
+    ret = mpu_input_setup(md);
+    if (ret)
+        dev_warn(&client->dev, "input registration failed (%d)\n", ret);
+
+    /* powered at bind; the bring-up work drops this reference when done */
+    pm_runtime_get_noresume(&client->dev);
+    pm_runtime_set_active(&client->dev);
+    pm_runtime_set_autosuspend_delay(&client->dev, MPU_AUTOSUSPEND_MS);
+    pm_runtime_use_autosuspend(&client->dev);
+    pm_runtime_enable(&client->dev);
+
+    /* only now can open() find it; it waits for the bring-up */
+    mutex_lock(&mpu_devs_lock);
+    mpu_devs[md->minor] = md;
+    mutex_unlock(&mpu_devs_lock);
+    schedule_work(&md->boot.work);
     return 0;
+
+err_files:
+    mpu_remove_files(&client->dev);
+err_minor:
+    ida_free(&mpu_minors, md->minor);
+err_free:
+    kref_put(&md->ref, mpu_dev_release);
+    return ret;
 }
 
 static void mpu_remove(struct i2c_client *client)
 {
-    device_destroy(mpu_class, mpu_devt);
-    class_destroy(mpu_class);
-    cdev_del(&mpu_cdev);
-    unregister_chrdev_region(mpu_devt, 1);
+    struct mpu_dev *md = i2c_get_clientdata(client);
 
-    device_remove_file(&client->dev, &dev_attr_accel_x);
-    device_remove_file(&client->dev, &dev_attr_accel_y);
-    device_remove_file(&client->dev, &dev_attr_accel_z);
-    device_remove_file(&client->dev, &dev_attr_temp);
-    device_remove_file(&client->dev, &dev_attr_gyro_x);
-    device_remove_file(&client->dev, &dev_attr_gyro_y);
-    device_remove_file(&client->dev, &dev_attr_gyro_z);
+    mutex_lock(&mpu_devs_lock);
+    mpu_devs[md->minor] = NULL;
+    mutex_unlock(&mpu_devs_lock);
 
-    pr_info(DRIVER_NAME ": removed\n");
+    /* let the bring-up finish, it holds a runtime PM reference */
+    flush_work(&md->boot.work);
+    mpu_capture_teardown(md);
+    mpu_input_teardown(md);
+    mpu_iio_teardown(md);
+    debugfs_remove_recursive(md->debugfs_dir);
+    if (md->minor == 0)
+        device_destroy(mpu_class, MKDEV(MAJOR(mpu_devt), MPU_COMPAT_MINOR));
+    device_destroy(mpu_class, MKDEV(MAJOR(mpu_devt), md->minor));
+
+    /* awake for the teardown writes, asleep when we let go */
+    pm_runtime_get_sync(&client->dev);
+    mpu_stream_stop(md);
+    mpu_drdy_enable(md, false);
+    mpu_motion_enable(md, false);
+    mutex_lock(&md->mode_lock);
+    mpu_timer_stop(md);
+    mutex_unlock(&md->mode_lock);
+
+    /* files still open now fail with -ENODEV instead of touching the client */
+    mutex_lock(&md->lock);
+    mpu_write_reg(md, REG_PWR_MGMT_1, PWR_MGMT_1_SLEEP);
+    md->dead = true;
+    mutex_unlock(&md->lock);
+    pm_runtime_disable(&client->dev);
+    pm_runtime_dont_use_autosuspend(&client->dev);
+    pm_runtime_set_suspended(&client->dev);
+    pm_runtime_put_noidle(&client->dev);
+    wake_up_interruptible(&md->wq);
+    cancel_delayed_work_sync(&md->stream.work); /* if a file re-armed it meanwhile */
+    cancel_work_sync(&md->adapt.work);
+
+    mpu_drdy_teardown(md);
+    mpu_remove_files(&client->dev);
+    ida_free(&mpu_minors, md->minor);
+    kref_put(&md->ref, mpu_dev_release);
+
+    dev_info(&client->dev, "removed\n");
 }
 
 /* i2c id table */
@@ -296,51 +4464,182 @@ MODULE_DEVICE_TABLE(i2c, mpu_id);
 static struct i2c_driver mpu_driver = {
     .driver = {
         .name = DRIVER_NAME,
+        .pm = pm_ptr(&mpu_pm_ops),
+        .probe_type = PROBE_PREFER_ASYNCHRONOUS,
     },
     .probe = mpu_probe,
     .remove = mpu_remove,
     .id_table = mpu_id,
 };
 
-/* module init/exit: create client then add driver (this guarantees probe called) */
-static int __init mpu_init(void)
+/* list entry i, a short list repeats its last value */
+static int mpu_param(const int *vals, int n, int i)
+{
+    return vals[min(i, max(n, 1) - 1)];
+}
+
+static void mpu_slot_put_lookup(struct mpu_slot *slot)
 {
+    if (!slot->lookup)
+        return;
+    gpiod_remove_lookup_table(slot->lookup);
+    kfree(slot->lookup);
+    slot->lookup = NULL;
+}
+
+/* create one sensor client; its INT line is looked up as "int" by mpu_drdy_setup() */
+static int mpu_add_slot(int bus, int addr, int gpio)
+{
+    struct mpu_slot *slot = &mpu_slots[mpu_nr_slots];
     struct i2c_board_info info;
+    struct i2c_adapter *adap;
     int ret;
 
-    pr_info(DRIVER_NAME ": init (bus=%d addr=0x%02x)\n", i2c_bus, i2c_addr);
+    memset(&info, 0, sizeof(info));
+    strscpy(info.type, "mpu6050", I2C_NAME_SIZE);
+    info.addr = addr;
 
-    mpu_i2c_adapter = i2c_get_adapter(i2c_bus);
-    if (!mpu_i2c_adapter) {
-        pr_err(DRIVER_NAME ": cannot get I2C adapter %d\n", i2c_bus);
-        return -ENODEV;
+    /* must be in place before the client appears and probes */
+    if (gpio >= 0) {
+        slot->lookup = kzalloc(struct_size(slot->lookup, table, 2), GFP_KERNEL);
+        if (!slot->lookup)
+            return -ENOMEM;
+        snprintf(slot->dev_id, sizeof(slot->dev_id), "%d-%04x", bus, addr);
+        slot->lookup->dev_id = slot->dev_id;
+        slot->lookup->table[0] = (struct gpiod_lookup)
+            GPIO_LOOKUP(gpio_chip, gpio, "int", GPIO_ACTIVE_HIGH);
+        gpiod_add_lookup_table(slot->lookup);
     }
 
-    memset(&info, 0, sizeof(info));
-    strscpy(info.type, "mpu6050", I2C_NAME_SIZE);
-    info.addr = i2c_addr;
+    adap = i2c_get_adapter(bus);
+    if (!adap) {
+        pr_err(DRIVER_NAME ": cannot get I2C adapter %d\n", bus);
+        ret = -ENODEV;
+        goto err_gpio;
+    }
+    slot->client = i2c_new_client_device(adap, &info);
+    i2c_put_adapter(adap);
+    if (IS_ERR(slot->client)) {
+        ret = PTR_ERR(slot->client);
+        pr_err(DRIVER_NAME ": failed to create client %d-%04x (%d)\n", bus, addr, ret);
+        goto err_gpio;
+    }
+    mpu_nr_slots++;
+    return 0;
 
-    mpu_i2c_client = i2c_new_client_device(mpu_i2c_adapter, &info);
-    if (!mpu_i2c_client) {
-        pr_err(DRIVER_NAME ": failed to create client at 0x%02x\n", i2c_addr);
-        i2c_put_adapter(mpu_i2c_adapter);
-        return -ENODEV;
+err_gpio:
+    mpu_slot_put_lookup(slot);
+    slot->client = NULL;
+    return ret;
+}
+
+static void mpu_del_slots(void)
+{
+    while (mpu_nr_slots) {
+        struct mpu_slot *slot = &mpu_slots[--mpu_nr_slots];
+
+        i2c_unregister_device(slot->client);
+        mpu_slot_put_lookup(slot);
     }
+}
 
-    ret = i2c_add_driver(&mpu_driver);
-    i2c_put_adapter(mpu_i2c_adapter);
+/* module init/exit: add driver then create clients (each probes as it appears) */
+static int __init mpu_init(void)
+{
+    struct device *node;
+    int nr, i, bus, addr, ret;
+
+    nr = max3(n_i2c_bus, n_i2c_addr, 1);
+    mpu_debugfs_root = debugfs_create_dir(DRIVER_NAME, NULL);
+
+    ret = alloc_chrdev_region(&mpu_devt, 0, MPU_NR_MINORS, DEVICE_NAME);
+    if (ret) {
+        pr_err(DRIVER_NAME ": alloc_chrdev_region failed\n");
+        goto err_debugfs;
+    }
+    cdev_init(&mpu_cdev, &mpu_fops);
+    mpu_cdev.owner = THIS_MODULE;
+    ret = cdev_add(&mpu_cdev, mpu_devt, MPU_MAX_DEVICES);
+    if (ret) {
+        pr_err(DRIVER_NAME ": cdev_add failed\n");
+        goto err_region;
+    }
+    cdev_init(&mpu_group_cdev, &mpu_group_fops);
+    mpu_group_cdev.owner = THIS_MODULE;
+    ret = cdev_add(&mpu_group_cdev, MKDEV(MAJOR(mpu_devt), MPU_GROUP_MINOR), 1);
+    if (ret) {
+        pr_err(DRIVER_NAME ": cdev_add failed\n");
+        goto err_cdev;
+    }
+    cdev_init(&mpu_compat_cdev, &mpu_fops);
+    mpu_compat_cdev.owner = THIS_MODULE;
+    ret = cdev_add(&mpu_compat_cdev, MKDEV(MAJOR(mpu_devt), MPU_COMPAT_MINOR), 1);
+    if (ret) {
+        pr_err(DRIVER_NAME ": cdev_add failed\n");
+        goto err_group_cdev;
+    }
+    mpu_class = class_create(DEVICE_NAME);
+    if (IS_ERR(mpu_class)) {
+        pr_err(DRIVER_NAME ": class_create failed\n");
+        ret = PTR_ERR(mpu_class);
+        goto err_compat_cdev;
+    }
+    node = device_create(mpu_class, NULL, MKDEV(MAJOR(mpu_devt), MPU_GROUP_MINOR), NULL,
+                         DEVICE_NAME "-group");
+    if (IS_ERR(node)) {
+        ret = PTR_ERR(node);
+        goto err_class;
+    }
 
+    ret = i2c_add_driver(&mpu_driver);
     if (ret) {
         pr_err(DRIVER_NAME ": failed to add driver (%d)\n", ret);
-        i2c_unregister_device(mpu_i2c_client);
+        goto err_group_node;
+    }
+
+    for (i = 0; i < nr; i++) {
+        bus = mpu_param(i2c_bus, n_i2c_bus, i);
+        addr = mpu_param(i2c_addr, n_i2c_addr, i);
+        pr_info(DRIVER_NAME ": init (bus=%d addr=0x%02x)\n", bus, addr);
+        mpu_add_slot(bus, addr, i < n_irq_gpio ? irq_gpio[i] : -1);
     }
+    if (!mpu_nr_slots) {
+        ret = -ENODEV;
+        goto err_driver;
+    }
+    return 0;
+
+err_driver:
+    i2c_del_driver(&mpu_driver);
+err_group_node:
+    device_destroy(mpu_class, MKDEV(MAJOR(mpu_devt), MPU_GROUP_MINOR));
+err_class:
+    class_destroy(mpu_class);
+err_compat_cdev:
+    cdev_del(&mpu_compat_cdev);
+err_group_cdev:
+    cdev_del(&mpu_group_cdev);
+err_cdev:
+    cdev_del(&mpu_cdev);
+err_region:
+    unregister_chrdev_region(mpu_devt, MPU_NR_MINORS);
+err_debugfs:
+    debugfs_remove_recursive(mpu_debugfs_root);
     return ret;
 }
 
 static void __exit mpu_exit(void)
 {
-    i2c_unregister_device(mpu_i2c_client);
+    mpu_del_slots();
     i2c_del_driver(&mpu_driver);
+    device_destroy(mpu_class, MKDEV(MAJOR(mpu_devt), MPU_GROUP_MINOR));
+    class_destroy(mpu_class);
+    cdev_del(&mpu_compat_cdev);
+    cdev_del(&mpu_group_cdev);
+    cdev_del(&mpu_cdev);
+    unregister_chrdev_region(mpu_devt, MPU_NR_MINORS);
+    debugfs_remove_recursive(mpu_debugfs_root);
+    ida_destroy(&mpu_minors);
     pr_info(DRIVER_NAME ": exit\n");
 }
 
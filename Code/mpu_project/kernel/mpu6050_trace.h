@@ -0,0 +1,115 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * mpu6050_trace.h - tracepoints for mpu6050_kmod. One sample's path is
+ * acq_start -> acq_end -> push -> reader_wake -> read, so the gaps give
+ * bus time, publish latency and the reader's scheduling and copy-out cost:
+ *
+ *   trace-cmd record -e mpu6050 ...
+ *
+ * minor is N of /dev/mpu6050-N.
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM mpu6050
+
+#if !defined(_MPU6050_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _MPU6050_TRACE_H
+
+#include <linux/tracepoint.h>
+
+/* a burst read or a FIFO drain is about to hit the bus */
+TRACE_EVENT(mpu6050_acq_start,
+    TP_PROTO(int minor, u32 mode),
+    TP_ARGS(minor, mode),
+    TP_STRUCT__entry(
+        __field(int, minor)
+        __field(u32, mode)
+    ),
+    TP_fast_assign(
+        __entry->minor = minor;
+        __entry->mode = mode;
+    ),
+    TP_printk("minor=%d mode=%u", __entry->minor, __entry->mode)
+);
+
+/* bytes of sample data read, ret < 0 on a bus error */
+TRACE_EVENT(mpu6050_acq_end,
+    TP_PROTO(int minor, u32 bytes, int ret),
+    TP_ARGS(minor, bytes, ret),
+    TP_STRUCT__entry(
+        __field(int, minor)
+        __field(u32, bytes)
+        __field(int, ret)
+    ),
+    TP_fast_assign(
+        __entry->minor = minor;
+        __entry->bytes = bytes;
+        __entry->ret = ret;
+    ),
+    TP_printk("minor=%d bytes=%u ret=%d", __entry->minor, __entry->bytes, __entry->ret)
+);
+
+/* one record published to the ring; head is its slot number */
+TRACE_EVENT(mpu6050_push,
+    TP_PROTO(int minor, u32 seq, u32 head, u64 timestamp_ns),
+    TP_ARGS(minor, seq, head, timestamp_ns),
+    TP_STRUCT__entry(
+        __field(int, minor)
+        __field(u32, seq)
+        __field(u32, head)
+        __field(u64, timestamp_ns)
+    ),
+    TP_fast_assign(
+        __entry->minor = minor;
+        __entry->seq = seq;
+        __entry->head = head;
+        __entry->timestamp_ns = timestamp_ns;
+    ),
+    TP_printk("minor=%d seq=%u head=%u ts=%llu", __entry->minor, __entry->seq,
+              __entry->head, __entry->timestamp_ns)
+);
+
+/* a blocked read() got past its wait with avail records for it */
+TRACE_EVENT(mpu6050_reader_wake,
+    TP_PROTO(int minor, u32 cursor, u32 avail),
+    TP_ARGS(minor, cursor, avail),
+    TP_STRUCT__entry(
+        __field(int, minor)
+        __field(u32, cursor)
+        __field(u32, avail)
+    ),
+    TP_fast_assign(
+        __entry->minor = minor;
+        __entry->cursor = cursor;
+        __entry->avail = avail;
+    ),
+    TP_printk("minor=%d cursor=%u avail=%u", __entry->minor, __entry->cursor, __entry->avail)
+);
+
+/* read() returning to the caller, after copy_to_user */
+TRACE_EVENT(mpu6050_read,
+    TP_PROTO(int minor, u32 mode, ssize_t ret, u64 delivered),
+    TP_ARGS(minor, mode, ret, delivered),
+    TP_STRUCT__entry(
+        __field(int, minor)
+        __field(u32, mode)
+        __field(ssize_t, ret)
+        __field(u64, delivered)
+    ),
+    TP_fast_assign(
+        __entry->minor = minor;
+        __entry->mode = mode;
+        __entry->ret = ret;
+        __entry->delivered = delivered;
+    ),
+    TP_printk("minor=%d mode=%u ret=%zd delivered=%llu", __entry->minor, __entry->mode,
+              __entry->ret, __entry->delivered)
+);
+
+#endif /* _MPU6050_TRACE_H */
+
+/* built with -I$(src), see Makefile */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE mpu6050_trace
+#include <trace/define_trace.h>
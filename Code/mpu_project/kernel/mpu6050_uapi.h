@@ -0,0 +1,343 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+/*
+ * mpu6050_uapi.h - record layout and ioctls shared by mpu6050_kmod and
+ * its userspace readers (mpu_monitor, loggers, GUI).
+ *
+ * In MPU_FMT_RECORD format every record read from /dev/mpu6050-N starts with
+ * struct mpu_sample_hdr. Readers check hdr.version and advance by hdr.size,
+ * so fields can be appended later without breaking old binaries.
+ */
+#ifndef _MPU6050_UAPI_H
+#define _MPU6050_UAPI_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+#define MPU_REC_VERSION 1
+
+/* hdr.chan_mask bits */
+#define MPU_CHAN_ACCEL_X (1 << 0)
+#define MPU_CHAN_ACCEL_Y (1 << 1)
+#define MPU_CHAN_ACCEL_Z (1 << 2)
+#define MPU_CHAN_TEMP    (1 << 3)
+#define MPU_CHAN_GYRO_X  (1 << 4)
+#define MPU_CHAN_GYRO_Y  (1 << 5)
+#define MPU_CHAN_GYRO_Z  (1 << 6)
+#define MPU_CHAN_ACCEL   (MPU_CHAN_ACCEL_X | MPU_CHAN_ACCEL_Y | MPU_CHAN_ACCEL_Z)
+#define MPU_CHAN_GYRO    (MPU_CHAN_GYRO_X | MPU_CHAN_GYRO_Y | MPU_CHAN_GYRO_Z)
+#define MPU_CHAN_ALL     (MPU_CHAN_ACCEL | MPU_CHAN_TEMP | MPU_CHAN_GYRO)
+
+/* full-scale codes, same values as AFS_SEL / FS_SEL in the sensor */
+#define MPU_ACCEL_FS_2G   0
+#define MPU_ACCEL_FS_4G   1
+#define MPU_ACCEL_FS_8G   2
+#define MPU_ACCEL_FS_16G  3
+#define MPU_GYRO_FS_250   0
+#define MPU_GYRO_FS_500   1
+#define MPU_GYRO_FS_1000  2
+#define MPU_GYRO_FS_2000  3
+
+/* hdr.flags */
+#define MPU_REC_F_GAP    (1 << 0)   /* samples were lost just before this one */
+#define MPU_REC_F_CONFIG (1 << 1)   /* first sample after a rate/range change */
+#define MPU_REC_F_RATE   (1 << 2)   /* ...made by the adaptive rate controller */
+
+struct mpu_sample_hdr {
+    __u16 version;      /* MPU_REC_VERSION */
+    __u16 size;         /* size of the whole record in bytes */
+    __u32 seq;          /* per-device sample sequence number */
+    __u64 timestamp_ns; /* at acquisition, in the file's clock (MPU_IOC_SET_CLOCK) */
+    __u16 chan_mask;    /* MPU_CHAN_* read for this record, others repeat (MPU_IOC_SET_CHAN_RATES) */
+    __u16 flags;        /* MPU_REC_F_* */
+    __u16 odr_hz;       /* sensor output data rate when sampled */
+    __u8  accel_fs;     /* MPU_ACCEL_FS_* */
+    __u8  gyro_fs;      /* MPU_GYRO_FS_* */
+};
+
+struct mpu_sample {
+    struct mpu_sample_hdr hdr;
+    __s16 accel[3];     /* raw LSB, X/Y/Z */
+    __s16 temp;         /* raw LSB: degC = temp / 340 + 36.53 */
+    __s16 gyro[3];      /* raw LSB, X/Y/Z */
+    __u16 reserved;
+};
+
+/*
+ * MPU_FMT_SI: the same record scaled in the kernel with the ranges in
+ * hdr, so readers need no scale tables. hdr.size is sizeof this struct.
+ */
+struct mpu_sample_si {
+    struct mpu_sample_hdr hdr;
+    __s32 accel[3];     /* micro-g, X/Y/Z */
+    __s32 temp;         /* milli-degC */
+    __s32 gyro[3];      /* milli-deg/s, X/Y/Z */
+    __u32 reserved;
+};
+
+/* read() formats, selected per open file */
+#define MPU_FMT_LEGACY 0    /* packed LE int16 ax,ay,az[,temp,gx,gy,gz]: 6 or 14 bytes */
+#define MPU_FMT_RECORD 1    /* struct mpu_sample */
+#define MPU_FMT_SI     2    /* struct mpu_sample_si */
+
+#define MPU_IOC_MAGIC 'm'
+#define MPU_IOC_SET_FMT _IOW(MPU_IOC_MAGIC, 1, __u32)
+#define MPU_IOC_GET_FMT _IOR(MPU_IOC_MAGIC, 2, __u32)
+
+/* acquisition modes, per sensor */
+#define MPU_MODE_ONDEMAND 0 /* each read() does one bus burst */
+#define MPU_MODE_FIFO     1 /* on-chip FIFO drained into a kernel buffer */
+#define MPU_MODE_DRDY     2 /* data-ready irq latches samples, read() waits for a new one */
+#define MPU_MODE_TIMER    3 /* kernel hrtimer paces burst reads at sysfs timer_rate_hz */
+
+#define MPU_IOC_SET_MODE      _IOW(MPU_IOC_MAGIC, 3, __u32)
+#define MPU_IOC_GET_MODE      _IOR(MPU_IOC_MAGIC, 4, __u32)
+/* records queued before poll() reports readable in FIFO mode */
+#define MPU_IOC_SET_WATERMARK _IOW(MPU_IOC_MAGIC, 5, __u32)
+#define MPU_IOC_GET_WATERMARK _IOR(MPU_IOC_MAGIC, 6, __u32)
+/* bytes to mmap() for the whole sample ring */
+#define MPU_IOC_GET_RING_SIZE _IOR(MPU_IOC_MAGIC, 7, __u32)
+
+/* sensor configuration; SET writes back the rate actually programmed */
+struct mpu_config {
+    __u16 odr_hz;       /* output data rate, 0 on SET keeps the current one */
+    __u8  dlpf;         /* DLPF_CFG 0..6: 260/184/94/44/21/10/5 Hz accel bandwidth */
+    __u8  accel_fs;     /* MPU_ACCEL_FS_* */
+    __u8  gyro_fs;      /* MPU_GYRO_FS_* */
+    __u8  reserved[3];
+};
+#define MPU_IOC_SET_CONFIG _IOWR(MPU_IOC_MAGIC, 8, struct mpu_config)
+#define MPU_IOC_GET_CONFIG _IOR(MPU_IOC_MAGIC, 9, struct mpu_config)
+
+/*
+ * Every open file reads the device's sample stream through its own
+ * cursor. In FIFO, DRDY and TIMER mode it gets every decim-th sample
+ * (1..1000, default 1); a file that falls a whole ring behind loses the
+ * oldest samples, counts them in overruns and sees MPU_REC_F_GAP on the
+ * next one.
+ */
+#define MPU_IOC_SET_DECIM _IOW(MPU_IOC_MAGIC, 10, __u32)
+#define MPU_IOC_GET_DECIM _IOR(MPU_IOC_MAGIC, 11, __u32)
+
+struct mpu_reader_stats {
+    __u64 delivered;    /* records returned by read() on this file */
+    __u64 overruns;     /* samples this file lost to the ring wrapping */
+    __u32 avail;        /* records readable right now */
+    __u32 decim;
+};
+#define MPU_IOC_GET_READER_STATS _IOR(MPU_IOC_MAGIC, 12, struct mpu_reader_stats)
+
+/*
+ * Optional filter applied to streamed samples (FIFO, DRDY, TIMER mode)
+ * before anyone sees them: one record is published per decim inputs, with
+ * hdr.odr_hz divided accordingly. Integer arithmetic only.
+ */
+#define MPU_FILTER_NONE   0     /* plain decimation, or pass-through with decim 1 */
+#define MPU_FILTER_BOXCAR 1     /* mean of each block of decim samples */
+#define MPU_FILTER_CIC    2     /* CIC of order stages, scaled to unity DC gain */
+#define MPU_FILTER_FIR    3     /* Q15 taps, taps[0] on the newest sample */
+
+#define MPU_FILTER_MAX_DECIM 256
+#define MPU_CIC_MAX_STAGES   4
+#define MPU_FIR_MAX_TAPS     16
+
+struct mpu_filter_cfg {
+    __u8  type;         /* MPU_FILTER_* */
+    __u8  stages;       /* CIC: 1..MPU_CIC_MAX_STAGES */
+    __u8  ntaps;        /* FIR: 1..MPU_FIR_MAX_TAPS */
+    __u8  reserved;
+    __u16 decim;        /* 1..MPU_FILTER_MAX_DECIM */
+    __u16 reserved2;
+    __s16 taps[MPU_FIR_MAX_TAPS];
+};
+#define MPU_IOC_SET_FILTER _IOW(MPU_IOC_MAGIC, 13, struct mpu_filter_cfg)
+#define MPU_IOC_GET_FILTER _IOR(MPU_IOC_MAGIC, 14, struct mpu_filter_cfg)
+
+/*
+ * Motion detection (needs the INT pin). The sensor raises an event once
+ * the high-passed acceleration exceeds threshold_mg on any axis for
+ * duration_ms. poll() then reports EPOLLPRI on every open file until that
+ * file calls MPU_IOC_GET_MOTION_EVENT.
+ */
+struct mpu_motion_cfg {
+    __u16 threshold_mg; /* 0 disarms, max 510, 2 mg steps */
+    __u8  duration_ms;  /* 1..255 when armed */
+    __u8  reserved;
+};
+#define MPU_IOC_SET_MOTION _IOW(MPU_IOC_MAGIC, 15, struct mpu_motion_cfg)
+#define MPU_IOC_GET_MOTION _IOR(MPU_IOC_MAGIC, 16, struct mpu_motion_cfg)
+
+struct mpu_motion_event {
+    __u64 timestamp_ns; /* CLOCK_MONOTONIC of the newest event */
+    __u32 count;        /* events since the sensor was bound */
+    __u32 missed;       /* older events this file had not fetched */
+};
+#define MPU_IOC_GET_MOTION_EVENT _IOR(MPU_IOC_MAGIC, 17, struct mpu_motion_event)
+
+/*
+ * Clock of hdr.timestamp_ns for read() on this file: CLOCK_MONOTONIC
+ * (default), CLOCK_MONOTONIC_RAW or CLOCK_BOOTTIME. The mmap ring is
+ * always CLOCK_MONOTONIC.
+ */
+#define MPU_IOC_SET_CLOCK _IOW(MPU_IOC_MAGIC, 18, __u32)
+#define MPU_IOC_GET_CLOCK _IOR(MPU_IOC_MAGIC, 19, __u32)
+
+/*
+ * Adaptive output rate for streamed modes: every window_ms the driver
+ * takes the RMS of the high-passed acceleration; above up_mg it switches
+ * to hi_hz/hi_dlpf, below down_mg for hold windows in a row back to
+ * lo_hz/lo_dlpf. Records at a new rate carry MPU_REC_F_RATE and the new
+ * hdr.odr_hz. While on, the controller owns odr_hz and dlpf.
+ */
+struct mpu_adaptive_cfg {
+    __u16 lo_hz;        /* idle rate, 0 turns the controller off */
+    __u16 hi_hz;        /* active rate, above lo_hz */
+    __u8  lo_dlpf;      /* DLPF_CFG 0..6 at each rate */
+    __u8  hi_dlpf;
+    __u16 window_ms;    /* 10..10000 */
+    __u16 up_mg;
+    __u16 down_mg;      /* below up_mg */
+    __u16 hold;         /* quiet windows before dropping to lo_hz, >= 1 */
+    __u16 reserved;
+};
+#define MPU_IOC_SET_ADAPTIVE _IOW(MPU_IOC_MAGIC, 22, struct mpu_adaptive_cfg)
+#define MPU_IOC_GET_ADAPTIVE _IOR(MPU_IOC_MAGIC, 23, struct mpu_adaptive_cfg)
+
+/*
+ * Channel rate groups: 0 reads a group with every sample, N at most N
+ * times a second, repeating its last value in between; hdr.chan_mask has
+ * only the channels read for that record. Bursts cover just the groups
+ * due, but TEMP lies between ACCEL and GYRO in the register map, so it is
+ * only skipped when one of those is not due either. In FIFO mode rate-0
+ * groups fill the FIFO frame and the others are read directly when due.
+ */
+struct mpu_chan_rates {
+    __u16 accel_hz;
+    __u16 temp_hz;
+    __u16 gyro_hz;
+    __u16 reserved;
+};
+#define MPU_IOC_SET_CHAN_RATES _IOW(MPU_IOC_MAGIC, 24, struct mpu_chan_rates)
+#define MPU_IOC_GET_CHAN_RATES _IOR(MPU_IOC_MAGIC, 25, struct mpu_chan_rates)
+
+/*
+ * Flight recorder: once armed, published records run through a circular
+ * buffer of pre + post slots. When |a| crosses threshold_mg (above, or
+ * below with MPU_CAPTURE_F_BELOW for free fall) or on
+ * MPU_IOC_CAPTURE_TRIGGER, post more records starting with the trigger
+ * record are taken and the buffer freezes until the next SET. Arming keeps
+ * the sensor streaming (DRDY, else FIFO, else TIMER) with no file open;
+ * records are those readers see, after any MPU_IOC_SET_FILTER decimation.
+ */
+#define MPU_CAPTURE_MAX     65536
+#define MPU_CAPTURE_F_BELOW (1 << 0)
+
+struct mpu_capture_cfg {
+    __u32 pre;          /* records kept before the trigger */
+    __u32 post;         /* records from the trigger on, >= 1; pre = post = 0 disarms */
+    __u16 threshold_mg; /* 0: only MPU_IOC_CAPTURE_TRIGGER fires */
+    __u16 flags;        /* MPU_CAPTURE_F_* */
+    __u32 reserved;
+};
+#define MPU_IOC_SET_CAPTURE     _IOW(MPU_IOC_MAGIC, 26, struct mpu_capture_cfg)
+#define MPU_IOC_GET_CAPTURE     _IOR(MPU_IOC_MAGIC, 27, struct mpu_capture_cfg)
+#define MPU_IOC_CAPTURE_TRIGGER _IO(MPU_IOC_MAGIC, 28)
+
+/* capture states */
+#define MPU_CAPTURE_IDLE      0
+#define MPU_CAPTURE_ARMED     1 /* recording, waiting for the trigger */
+#define MPU_CAPTURE_TRIGGERED 2 /* taking the post-trigger records */
+#define MPU_CAPTURE_DONE      3 /* frozen, readable */
+
+#define MPU_CAPTURE_SRC_THRESHOLD 0
+#define MPU_CAPTURE_SRC_IOCTL     1
+
+/*
+ * sysfs <i2c dev>/capture reads as this header followed, once DONE, by nr
+ * struct mpu_sample records oldest first. poll() on it wakes when the
+ * buffer freezes.
+ */
+#define MPU_CAPTURE_VERSION 1
+
+struct mpu_capture_hdr {
+    __u16 version;      /* MPU_CAPTURE_VERSION */
+    __u16 state;        /* MPU_CAPTURE_* */
+    __u32 id;           /* changes on every MPU_IOC_SET_CAPTURE */
+    __u32 nr;           /* records following, 0 unless DONE */
+    __u32 trigger;      /* index of the trigger record */
+    __u64 trigger_ns;   /* CLOCK_MONOTONIC of the trigger */
+    __u32 record_size;  /* sizeof(struct mpu_sample) */
+    __u16 source;       /* MPU_CAPTURE_SRC_* */
+    __u16 reserved;
+};
+
+/*
+ * /dev/mpu6050-group: MPU_IOC_SET_GROUP picks up to MPU_GROUP_MAX sensors
+ * on one I2C adapter for this file. Each read() then samples all of them
+ * in a single combined transfer and returns one struct mpu_group_sample
+ * of size bytes (header plus nr members, sorted by minor).
+ */
+#define MPU_GROUP_MAX 8
+
+struct mpu_group_cfg {
+    __u32 nr;
+    __u8  minor[MPU_GROUP_MAX]; /* N of /dev/mpu6050-N */
+};
+#define MPU_IOC_SET_GROUP _IOW(MPU_IOC_MAGIC, 20, struct mpu_group_cfg)
+#define MPU_IOC_GET_GROUP _IOR(MPU_IOC_MAGIC, 21, struct mpu_group_cfg)
+
+/*
+ * Group pacing: 0 (default) samples the group once per read(). N samples
+ * it on a kernel hrtimer N times a second; read() then blocks for queued
+ * records and returns as many whole ones as fit, oldest first. A record
+ * after lost ticks or a full queue has MPU_REC_F_GAP in flags.
+ */
+#define MPU_GROUP_MAX_HZ 1000
+#define MPU_IOC_SET_GROUP_RATE _IOW(MPU_IOC_MAGIC, 29, __u32)
+#define MPU_IOC_GET_GROUP_RATE _IOR(MPU_IOC_MAGIC, 30, __u32)
+
+struct mpu_group_member {
+    __u8  minor;
+    __u8  accel_fs;     /* MPU_ACCEL_FS_* */
+    __u8  gyro_fs;      /* MPU_GYRO_FS_* */
+    __u8  reserved;
+    __s16 accel[3];     /* raw LSB, X/Y/Z */
+    __s16 temp;
+    __s16 gyro[3];
+    __u16 reserved2;
+};
+
+struct mpu_group_sample {
+    __u16 version;      /* MPU_REC_VERSION */
+    __u16 size;         /* bytes returned: header plus nr members */
+    __u32 seq;          /* per-file record number */
+    __u64 timestamp_ns; /* CLOCK_MONOTONIC at the start of the combined transfer */
+    __u32 span_ns;      /* transfer duration, bounds the skew between members */
+    __u16 nr;
+    __u16 flags;
+    struct mpu_group_member member[MPU_GROUP_MAX];
+};
+
+/*
+ * Read-only mmap() of /dev/mpu6050-N: one header page followed by nr_slots
+ * struct mpu_sample slots at data_offset. Every sample the driver acquires
+ * (any mode) is published here; sample i lives in slot i & (nr_slots - 1).
+ *
+ * The kernel fills a slot and then store-releases head. A reader
+ * load-acquires head, copies slots below it, then re-loads head (acquire)
+ * and keeps a copied index i only if head - i < nr_slots; otherwise the
+ * producer may have overwritten it mid-copy. Indices are u32 and wrap.
+ */
+#define MPU_RING_VERSION 1
+
+struct mpu_ring_hdr {
+    __u32 version;      /* MPU_RING_VERSION */
+    __u32 slot_size;    /* sizeof(struct mpu_sample) */
+    __u32 nr_slots;     /* power of two */
+    __u32 data_offset;  /* offset of slot 0 from the start of the mapping */
+    __u32 head;         /* producer index: samples published so far */
+    __u32 latest;       /* index of the newest sample, valid once head != 0 */
+    __u32 overruns;     /* samples lost before reaching the ring (FIFO overflow) */
+    __u32 errors;       /* failed bus acquisitions */
+};
+
+#endif /* _MPU6050_UAPI_H */
@@ -11,6 +11,9 @@
 #include <string.h>
 #include <stdlib.h>
 #include <sys/stat.h>
+#include <sys/ioctl.h>
+
+#include "../kernel/mpu6050_uapi.h"
 
 static long get_total_jiffies(void) {
     FILE *f = fopen("/proc/stat","r");
@@ -48,15 +51,27 @@ static double timespec_to_double(const struct timespec *t) {
 }
 
 int main(int argc, char **argv) {
-    const char *dev = "/dev/mpu6050";
+    // one node per sensor: /dev/mpu6050-0, /dev/mpu6050-1, ...
+    const char *dev = "/dev/mpu6050-0";
     if (argc > 1) dev = argv[1];
 
     int fd = open(dev, O_RDONLY);
     if (fd < 0) {
-        perror("open /dev/mpu6050");
+        perror(dev);
         return 1;
     }
 
+    // scaled in the kernel with the current ranges, no scale tables here
+    uint32_t fmt = MPU_FMT_SI;
+    if (ioctl(fd, MPU_IOC_SET_FMT, &fmt) < 0) {
+        perror("MPU_IOC_SET_FMT");
+        close(fd);
+        return 1;
+    }
+    // in data-ready/FIFO mode read() blocks until a new sample, no need to sleep
+    uint32_t mode = MPU_MODE_ONDEMAND;
+    ioctl(fd, MPU_IOC_GET_MODE, &mode);
+
     initscr();
     noecho();
     curs_set(FALSE);
@@ -65,33 +80,28 @@ int main(int argc, char **argv) {
     pid_t pid = getpid();
     long prev_total = get_total_jiffies();
     long prev_proc = get_proc_jiffies(pid);
-    struct timespec prev_ts;
-    clock_gettime(CLOCK_MONOTONIC, &prev_ts);
+    uint64_t prev_ts_ns = 0;
 
     while (1) {
-        uint8_t buf[6];
+        struct mpu_sample_si s;
         struct timespec t0, t1;
         clock_gettime(CLOCK_MONOTONIC, &t0);
-        ssize_t r = read(fd, buf, 6);
+        ssize_t r = read(fd, &s, sizeof(s));
         clock_gettime(CLOCK_MONOTONIC, &t1);
-        if (r != 6) {
-            mvprintw(0,0,"read returned %ld", r);
+        if (r != sizeof(s) || s.hdr.version != MPU_REC_VERSION) {
+            mvprintw(0,0,"read returned %ld (record version %u)", r, r > 0 ? s.hdr.version : 0);
             refresh();
             usleep(100000);
             continue;
         }
 
-        int16_t ax = (int16_t)(buf[0] | (buf[1]<<8));
-        int16_t ay = (int16_t)(buf[2] | (buf[3]<<8));
-        int16_t az = (int16_t)(buf[4] | (buf[5]<<8));
-
         double t_read = timespec_to_double(&t1) - timespec_to_double(&t0);
 
-        struct timespec now;
-        clock_gettime(CLOCK_MONOTONIC, &now);
-        double dt = timespec_to_double(&now) - timespec_to_double(&prev_ts);
-        prev_ts = now;
+        // spacing and age from the kernel's acquisition stamp, not from when read() returned
+        double dt = prev_ts_ns ? (s.hdr.timestamp_ns - prev_ts_ns) / 1e9 : 0.0;
+        prev_ts_ns = s.hdr.timestamp_ns;
         if (dt <= 0) dt = 1e-6;
+        double age = timespec_to_double(&t1) - s.hdr.timestamp_ns / 1e9;
 
         long total = get_total_jiffies();
         long proc = get_proc_jiffies(pid);
@@ -102,17 +112,25 @@ int main(int argc, char **argv) {
         if (dtotal > 0) cpu_usage = 100.0 * (double)dproc / (double)dtotal;
 
         mvprintw(0,0,"MPU6050 Realtime Monitor (device: %s)", dev);
-        mvprintw(2,0,"Raw accel (LSB): Ax: %6d   Ay: %6d   Az: %6d", ax, ay, az);
-        // convert to m/s^2 using scale 16384 LSB/g and g=9.80665
-        double ax_ms2 = (double)ax * 9.80665 / 16384.0;
-        double ay_ms2 = (double)ay * 9.80665 / 16384.0;
-        double az_ms2 = (double)az * 9.80665 / 16384.0;
-        mvprintw(3,0,"Accel (m/s^2):  Ax: %7.3f   Ay: %7.3f   Az: %7.3f", ax_ms2, ay_ms2, az_ms2);
-
-        mvprintw(5,0,"Sample period dt: %.6f s   (%.2f Hz)", dt, 1.0/dt);
-        mvprintw(6,0,"Read latency (read syscall): %.3f ms", t_read*1e3);
-        mvprintw(7,0,"Process CPU usage (est): %.2f %%", cpu_usage);
-        mvprintw(9,0,"Press q to quit.");
+        mvprintw(2,0,"Accel (mg):     Ax: %8.2f  Ay: %8.2f  Az: %8.2f",
+                 s.accel[0] / 1e3, s.accel[1] / 1e3, s.accel[2] / 1e3);
+        // ug to m/s^2, g=9.80665
+        mvprintw(3,0,"Accel (m/s^2):  Ax: %7.3f   Ay: %7.3f   Az: %7.3f",
+                 s.accel[0] * 9.80665e-6, s.accel[1] * 9.80665e-6, s.accel[2] * 9.80665e-6);
+        mvprintw(4,0,"Gyro (deg/s):   Gx: %7.2f   Gy: %7.2f   Gz: %7.2f",
+                 s.gyro[0] / 1e3, s.gyro[1] / 1e3, s.gyro[2] / 1e3);
+        mvprintw(5,0,"Temp: %6.2f C   seq: %u   ODR: %u Hz   mode: %u",
+                 s.temp / 1e3, s.hdr.seq, s.hdr.odr_hz, mode);
+
+        mvprintw(7,0,"Sample period dt: %.6f s   (%.2f Hz)", dt, 1.0/dt);
+        mvprintw(8,0,"Read latency (read syscall): %.3f ms   sample age: %.3f ms", t_read*1e3, age*1e3);
+        mvprintw(9,0,"Process CPU usage (est): %.2f %%", cpu_usage);
+        // samples this reader lost because it fell a whole ring behind
+        struct mpu_reader_stats rs;
+        if (ioctl(fd, MPU_IOC_GET_READER_STATS, &rs) == 0)
+            mvprintw(10,0,"Reader: delivered %llu   overruns %llu   decim %u",
+                     (unsigned long long)rs.delivered, (unsigned long long)rs.overruns, rs.decim);
+        mvprintw(11,0,"Press q to quit.");
 
         refresh();
 
@@ -122,7 +140,8 @@ int main(int argc, char **argv) {
         /* No sleep: read as fast as device/driver allows.
            If you want to throttle, uncomment below */
         // usleep(5000);
-        usleep(500000);
+        if (mode == MPU_MODE_ONDEMAND)
+            usleep(500000);
     }
 
     endwin();
@@ -6,6 +6,12 @@
 #include <linux/uaccess.h>
 #include <linux/cdev.h>
 #include <linux/device.h>
+#include <linux/workqueue.h>
+#include <linux/completion.h>
+#include <linux/ktime.h>
+
+#define CREATE_TRACE_POINTS
+#include "ssd1306_trace.h"
 
 #define DRIVER_NAME "ssd1306_i2c"
 #define DEVICE_NAME "ssd1306"
@@ -19,6 +25,13 @@ static dev_t dev_number;
 static struct class *ssd1306_class;
 static struct cdev ssd1306_cdev;
 static struct i2c_client *ssd1306_client;
+static u32 ssd1306_frame; // frames written so far, tags the trace events
+
+// probe only creates /dev/ssd1306; the init sequence runs from a work item
+static struct work_struct ssd1306_init_work;
+static DECLARE_COMPLETION(ssd1306_ready);
+static int ssd1306_init_ret;
+static u64 ssd1306_probe_ns;
 
 static int ssd1306_send_command(struct i2c_client *client, const u8 *cmds, int len)
 {
@@ -31,6 +44,7 @@ static int ssd1306_send_command(struct i2c_client *client, const u8 *cmds, int l
         buf[0] = 0x00; // control byte: Co = 0, D/C# = 0 (command)
         memcpy(&buf[1], &cmds[sent], chunk);
         ret = i2c_master_send(client, buf, chunk + 1);
+        trace_ssd1306_chunk(client->adapter->nr, client->addr, ssd1306_frame, buf[0], sent, chunk, ret);
         if (ret < 0) return ret;
         sent += chunk;
     }
@@ -48,6 +62,7 @@ static int ssd1306_send_data(struct i2c_client *client, const u8 *data, int len)
         buf[0] = 0x40; // control byte: Co = 0, D/C# = 1 (data)
         memcpy(&buf[1], &data[sent], chunk);
         ret = i2c_master_send(client, buf, chunk + 1);
+        trace_ssd1306_chunk(client->adapter->nr, client->addr, ssd1306_frame, buf[0], sent, chunk, ret);
         if (ret < 0) return ret;
         sent += chunk;
     }
@@ -78,16 +93,41 @@ static int ssd1306_init_display(struct i2c_client *client)
     return ssd1306_send_command(client, init_cmds, sizeof(init_cmds));
 }
 
+static void ssd1306_init_worker(struct work_struct *work)
+{
+    struct i2c_client *client = ssd1306_client;
+    int ret = ssd1306_init_display(client);
+
+    ssd1306_init_ret = ret < 0 ? ret : 0;
+    complete_all(&ssd1306_ready);
+    if (ret < 0)
+        dev_err(&client->dev, "init failed: %d\n", ret);
+    else
+        dev_info(&client->dev, DRIVER_NAME ": display ready %llu us after probe\n",
+                 div_u64(ktime_get_ns() - ssd1306_probe_ns, NSEC_PER_USEC));
+}
+
 static ssize_t ssd1306_write(struct file *file, const char __user *buf, size_t count, loff_t *ppos)
 {
     u8 *kbuf;
     int ret;
 
+    trace_ssd1306_write(ssd1306_client->adapter->nr, ssd1306_client->addr, ssd1306_frame + 1, count);
     if (count != BUFFER_SIZE) {
         pr_warn(DRIVER_NAME ": expected %d bytes (framebuffer), got %zu\n", BUFFER_SIZE, count);
         return -EINVAL;
     }
 
+    // the display is only usable once the init sequence has gone out
+    if (!completion_done(&ssd1306_ready)) {
+        if (file->f_flags & O_NONBLOCK)
+            return -EAGAIN;
+        if (wait_for_completion_interruptible(&ssd1306_ready))
+            return -ERESTARTSYS;
+    }
+    if (ssd1306_init_ret)
+        return ssd1306_init_ret;
+
     kbuf = kmalloc(BUFFER_SIZE, GFP_KERNEL);
     if (!kbuf) return -ENOMEM;
 
@@ -109,8 +149,11 @@ static ssize_t ssd1306_write(struct file *file, const char __user *buf, size_t c
         }
     }
 
+    ssd1306_frame++;
     ret = ssd1306_send_data(ssd1306_client, kbuf, BUFFER_SIZE);
     kfree(kbuf);
+    trace_ssd1306_frame_done(ssd1306_client->adapter->nr, ssd1306_client->addr, ssd1306_frame,
+                             ret < 0 ? 0 : BUFFER_SIZE, ret);
     if (ret < 0) return ret;
 
     return count;
@@ -126,15 +169,12 @@ static int ssd1306_probe(struct i2c_client *client)
     int ret;
 
     ssd1306_client = client;
+    ssd1306_probe_ns = ktime_get_ns();
+    reinit_completion(&ssd1306_ready);
+    INIT_WORK(&ssd1306_init_work, ssd1306_init_worker);
 
     dev_info(&client->dev, DRIVER_NAME ": probing at 0x%02x\n", client->addr);
 
-    ret = ssd1306_init_display(client);
-    if (ret < 0) {
-        dev_err(&client->dev, "init failed: %d\n", ret);
-        return ret;
-    }
-
     // create device node
     ret = alloc_chrdev_region(&dev_number, 0, 1, DEVICE_NAME);
     if (ret) {
@@ -165,11 +205,13 @@ static int ssd1306_probe(struct i2c_client *client)
     }
 
     dev_info(&client->dev, DRIVER_NAME ": device /dev/%s created\n", DEVICE_NAME);
+    schedule_work(&ssd1306_init_work);
     return 0;
 }
 
 static void ssd1306_remove(struct i2c_client *client)
 {
+    flush_work(&ssd1306_init_work);
     device_destroy(ssd1306_class, dev_number);
     class_destroy(ssd1306_class);
     cdev_del(&ssd1306_cdev);
@@ -193,6 +235,7 @@ static struct i2c_driver ssd1306_driver = {
     .driver = {
         .name = DRIVER_NAME,
         .of_match_table = ssd1306_of_match,
+        .probe_type = PROBE_PREFER_ASYNCHRONOUS,
     },
     .probe = ssd1306_probe,
     .remove = ssd1306_remove,
@@ -0,0 +1,88 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * ssd1306_trace.h - tracepoints for ssd1306_i2c: write() entry, every
+ * i2c_master_send chunk and frame completion, keyed by frame number.
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM ssd1306
+
+#if !defined(_SSD1306_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _SSD1306_TRACE_H
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(ssd1306_write,
+    TP_PROTO(int bus, u16 addr, u32 frame, size_t count),
+    TP_ARGS(bus, addr, frame, count),
+    TP_STRUCT__entry(
+        __field(int, bus)
+        __field(u16, addr)
+        __field(u32, frame)
+        __field(size_t, count)
+    ),
+    TP_fast_assign(
+        __entry->bus = bus;
+        __entry->addr = addr;
+        __entry->frame = frame;
+        __entry->count = count;
+    ),
+    TP_printk("bus=%d addr=0x%02x frame=%u count=%zu", __entry->bus, __entry->addr,
+              __entry->frame, __entry->count)
+);
+
+/* ctrl is the control byte: 0x00 command, 0x40 data */
+TRACE_EVENT(ssd1306_chunk,
+    TP_PROTO(int bus, u16 addr, u32 frame, u8 ctrl, int offset, int len, int ret),
+    TP_ARGS(bus, addr, frame, ctrl, offset, len, ret),
+    TP_STRUCT__entry(
+        __field(int, bus)
+        __field(u16, addr)
+        __field(u32, frame)
+        __field(u8, ctrl)
+        __field(int, offset)
+        __field(int, len)
+        __field(int, ret)
+    ),
+    TP_fast_assign(
+        __entry->bus = bus;
+        __entry->addr = addr;
+        __entry->frame = frame;
+        __entry->ctrl = ctrl;
+        __entry->offset = offset;
+        __entry->len = len;
+        __entry->ret = ret;
+    ),
+    TP_printk("bus=%d addr=0x%02x frame=%u ctrl=0x%02x offset=%d len=%d ret=%d",
+              __entry->bus, __entry->addr, __entry->frame, __entry->ctrl,
+              __entry->offset, __entry->len, __entry->ret)
+);
+
+TRACE_EVENT(ssd1306_frame_done,
+    TP_PROTO(int bus, u16 addr, u32 frame, int bytes, int ret),
+    TP_ARGS(bus, addr, frame, bytes, ret),
+    TP_STRUCT__entry(
+        __field(int, bus)
+        __field(u16, addr)
+        __field(u32, frame)
+        __field(int, bytes)
+        __field(int, ret)
+    ),
+    TP_fast_assign(
+        __entry->bus = bus;
+        __entry->addr = addr;
+        __entry->frame = frame;
+        __entry->bytes = bytes;
+        __entry->ret = ret;
+    ),
+    TP_printk("bus=%d addr=0x%02x frame=%u bytes=%d ret=%d", __entry->bus, __entry->addr,
+              __entry->frame, __entry->bytes, __entry->ret)
+);
+
+#endif /* _SSD1306_TRACE_H */
+
+/* built with -I$(src), see Makefile */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE ssd1306_trace
+#include <trace/define_trace.h>